@@ -8,7 +8,14 @@
 #include <iostream>
 #include <vector>
 #include <limits>
+#include <string>
 
+enum class AnxietyBand {
+    Any = -1,
+    Low = 0,
+    Medium = 1,
+    High = 2
+};
 
 class AnxietyTest {
 protected:
@@ -44,18 +51,48 @@ public:
         }
     }
 
-    void resultPrint(int result) {
-        if (result < 30) {
-            std::cout << "У вас низкая тревожность\n";
+    int size() const {
+        return numQuestions;
+    }
+
+    const std::string& question(int index) const {
+        return questions[index];
+    }
+
+    bool setAnswer(int index, int response) {
+        if (index < 0 || index >= numQuestions || response < 1 || response > 4) {
+            return false;
+        }
+        answers[index] = response;
+        return true;
+    }
+
+    // Шкала Спилбергера-Ханина: до 30 баллов - низкая, 31-45 - средняя, 46 и выше - высокая.
+    static AnxietyBand band(int result) {
+        if (result <= 30) {
+            return AnxietyBand::Low;
         }
-        else if (result >= 31 && result < 46) {
-            std::cout << "У вас средняя тревожность\n";
+        if (result <= 45) {
+            return AnxietyBand::Medium;
         }
-        else {
-            std::cout << "У вас высокая тревожность\n";
+        return AnxietyBand::High;
+    }
+
+    static const char* resultDescription(int result) {
+        switch (band(result)) {
+            case AnxietyBand::Low:
+                return "У вас низкая тревожность";
+            case AnxietyBand::Medium:
+                return "У вас средняя тревожность";
+            default:
+                return "У вас высокая тревожность";
         }
     }
 
+    void resultPrint(int result) {
+        std::cout << resultDescription(result) << "\n";
+    }
+
     virtual int calculateResult() = 0;
 };
 
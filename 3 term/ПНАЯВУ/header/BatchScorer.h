@@ -0,0 +1,321 @@
+#ifndef LAB_2_BATCHSCORER_H
+#define LAB_2_BATCHSCORER_H
+
+#include "../header/UserManager.h"
+#include "../header/ScoringEngine.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Пакетная обработка анкет без диалога.
+// CSV: "имя,a1,...,a20,b1,...,b20[,время]" - 20 ответов ситуативной шкалы, затем 20 личностной
+// и необязательное время прохождения в секундах Unix; пустые строки и строки, начинающиеся
+// с '#', пропускаются.
+// Бинарный формат: заголовок "ANXBIN01", затем записи BatchRecord фиксированной длины.
+// Анкеты без времени сохраняются с нулевым временем, как при импорте старых результатов,
+// чтобы архив не попадал в месяц загрузки.
+struct BatchRecord {
+    char name[32];
+    uint8_t answers[40];
+};
+
+class BatchScorer {
+private:
+    static constexpr size_t chunkSize = 1 << 20;
+    static constexpr size_t matrixRows = 4096;
+    static constexpr int numQuestions = 20;
+
+    struct Chunk {
+        uint64_t sequence;
+        std::string data;
+    };
+
+    struct Scored {
+        std::string name;
+        int16_t situational;
+        int16_t personal;
+        int64_t timestamp;
+    };
+
+    struct ChunkResult {
+        std::vector<Scored> rows;
+        size_t rejected = 0;
+    };
+
+    UserManager& userManager;
+    unsigned threadCount;
+    bool binary = false;
+
+    std::mutex mutex;
+    std::condition_variable queueChanged;
+    std::condition_variable resultReady;
+    std::deque<Chunk> queue;
+    std::map<uint64_t, ChunkResult> finished;
+    bool inputDone = false;
+    uint64_t nextCommit = 0;
+
+    size_t accepted = 0;
+    size_t rejected = 0;
+    size_t unknownUsers = 0;
+    size_t unsaved = 0;
+
+    static bool parseLine(const char* p, const char* end, std::string& name, uint8_t* answers, int64_t& timestamp) {
+        const char* comma = static_cast<const char*>(std::memchr(p, ',', end - p));
+        if (comma == nullptr || comma == p) {
+            return false;
+        }
+        name.assign(p, comma);
+        p = comma + 1;
+        for (int i = 0; i < 2 * numQuestions; i++) {
+            while (p < end && *p == ' ') {
+                p++;
+            }
+            if (p == end || *p < '1' || *p > '4') {
+                return false;
+            }
+            answers[i] = static_cast<uint8_t>(*p++ - '0');
+            while (p < end && *p == ' ') {
+                p++;
+            }
+            if (i + 1 < 2 * numQuestions) {
+                if (p == end || *p != ',') {
+                    return false;
+                }
+                p++;
+            }
+        }
+        timestamp = 0;
+        if (p < end && *p == ',') {
+            p++;
+            while (p < end && *p == ' ') {
+                p++;
+            }
+            const char* digits = p;
+            while (p < end && *p >= '0' && *p <= '9' && p - digits < 18) {
+                timestamp = timestamp * 10 + (*p++ - '0');
+            }
+            if (p == digits) {
+                return false;
+            }
+        }
+        while (p < end && (*p == ' ' || *p == '\r')) {
+            p++;
+        }
+        return p == end;
+    }
+
+    struct Batch {
+        AnswerMatrix situational{numQuestions, matrixRows};
+        AnswerMatrix personal{numQuestions, matrixRows};
+        std::vector<std::string> names;
+        std::vector<int64_t> timestamps;
+        int16_t situationalScores[matrixRows];
+        int16_t personalScores[matrixRows];
+
+        void add(const std::string& name, const uint8_t* answers, int64_t timestamp) {
+            situational.add(answers);
+            personal.add(answers + numQuestions);
+            names.push_back(name);
+            timestamps.push_back(timestamp);
+        }
+
+        void flush(ChunkResult& result) {
+            situational.score(Instrument::situational(), situationalScores);
+            personal.score(Instrument::personal(), personalScores);
+            for (size_t i = 0; i < names.size(); i++) {
+                result.rows.push_back({std::move(names[i]), situationalScores[i], personalScores[i], timestamps[i]});
+            }
+            situational.clear();
+            personal.clear();
+            names.clear();
+            timestamps.clear();
+        }
+    };
+
+    void processChunk(const Chunk& chunk, Batch& batch, ChunkResult& result) const {
+        const char* p = chunk.data.data();
+        const char* end = p + chunk.data.size();
+        std::string name;
+        uint8_t answers[2 * numQuestions];
+        int64_t timestamp;
+
+        if (binary) {
+            for (; p + sizeof(BatchRecord) <= end; p += sizeof(BatchRecord)) {
+                const auto* record = reinterpret_cast<const BatchRecord*>(p);
+                size_t length = strnlen(record->name, sizeof(record->name));
+                bool valid = length > 0;
+                for (int i = 0; i < 2 * numQuestions && valid; i++) {
+                    valid = record->answers[i] >= 1 && record->answers[i] <= 4;
+                }
+                if (!valid) {
+                    result.rejected++;
+                    continue;
+                }
+                batch.add(std::string(record->name, length), record->answers, 0);
+                if (batch.situational.full()) {
+                    batch.flush(result);
+                }
+            }
+        } else {
+            while (p < end) {
+                const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+                const char* lineEnd = newline ? newline : end;
+                if (lineEnd != p && *p != '#' && !(lineEnd - p == 1 && *p == '\r')) {
+                    if (parseLine(p, lineEnd, name, answers, timestamp)) {
+                        batch.add(name, answers, timestamp);
+                        if (batch.situational.full()) {
+                            batch.flush(result);
+                        }
+                    } else {
+                        result.rejected++;
+                    }
+                }
+                p = newline ? newline + 1 : end;
+            }
+        }
+        batch.flush(result);
+    }
+
+    void worker() {
+        Batch batch;
+        for (;;) {
+            Chunk chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                queueChanged.wait(lock, [this] { return !queue.empty() || inputDone; });
+                if (queue.empty()) {
+                    return;
+                }
+                chunk = std::move(queue.front());
+                queue.pop_front();
+            }
+            queueChanged.notify_all();
+
+            ChunkResult result;
+            processChunk(chunk, batch, result);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished.emplace(chunk.sequence, std::move(result));
+            }
+            resultReady.notify_one();
+        }
+    }
+
+    // Результаты записываются в хранилище одним потоком и в порядке чтения,
+    // чтобы история пользователя совпадала с порядком строк во входном файле.
+    void commitReady(bool wait, uint64_t upTo) {
+        while (nextCommit < upTo) {
+            ChunkResult result;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (wait) {
+                    resultReady.wait(lock, [this] { return finished.count(nextCommit) != 0; });
+                }
+                auto it = finished.find(nextCommit);
+                if (it == finished.end()) {
+                    return;
+                }
+                result = std::move(it->second);
+                finished.erase(it);
+            }
+            nextCommit++;
+            rejected += result.rejected;
+            size_t appended = 0;
+            for (const Scored& row : result.rows) {
+                if (userManager.appendResult(row.name, row.situational, row.personal, row.timestamp, false)) {
+                    appended++;
+                } else {
+                    unknownUsers++;
+                }
+            }
+            // Анкеты чанка засчитываются только после фиксации журнала.
+            if (userManager.commitPending()) {
+                accepted += appended;
+            } else {
+                unsaved += appended;
+            }
+        }
+    }
+
+    void submit(uint64_t sequence, std::string&& data) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queueChanged.wait(lock, [this] { return queue.size() < 2 * threadCount; });
+            queue.push_back({sequence, std::move(data)});
+        }
+        queueChanged.notify_all();
+    }
+
+public:
+    BatchScorer(UserManager& userManager, unsigned threads)
+            : userManager(userManager), threadCount(threads ? threads : 1) {}
+
+    bool run(FILE* input) {
+        std::string carry;
+        std::vector<char> buffer(chunkSize);
+        size_t got = std::fread(buffer.data(), 1, 8, input);
+        if (got == 8 && std::memcmp(buffer.data(), "ANXBIN01", 8) == 0) {
+            binary = true;
+        } else {
+            carry.assign(buffer.data(), got);
+        }
+
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < threadCount; i++) {
+            workers.emplace_back(&BatchScorer::worker, this);
+        }
+
+        uint64_t sequence = 0;
+        while ((got = std::fread(buffer.data(), 1, buffer.size(), input)) > 0) {
+            carry.append(buffer.data(), got);
+            size_t cut;
+            if (binary) {
+                cut = carry.size() - carry.size() % sizeof(BatchRecord);
+            } else {
+                size_t newline = carry.rfind('\n');
+                cut = newline == std::string::npos ? 0 : newline + 1;
+            }
+            if (cut == 0) {
+                continue;
+            }
+            std::string rest = carry.substr(cut);
+            carry.resize(cut);
+            submit(sequence++, std::move(carry));
+            carry = std::move(rest);
+            commitReady(false, sequence);
+        }
+        if (!carry.empty()) {
+            if (binary) {
+                rejected++;
+            } else {
+                submit(sequence++, std::move(carry));
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            inputDone = true;
+        }
+        queueChanged.notify_all();
+        commitReady(true, sequence);
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        std::cout << "Обработано анкет: " << accepted << ", отклонено: " << rejected
+                  << ", неизвестных пользователей: " << unknownUsers << "\n";
+        if (unsaved > 0) {
+            std::cout << "Не удалось записать в журнал анкет: " << unsaved << "\n";
+        }
+        return !std::ferror(input) && unsaved == 0;
+    }
+};
+
+#endif //LAB_2_BATCHSCORER_H
@@ -0,0 +1,173 @@
+#ifndef LAB_2_COHORTINDEX_H
+#define LAB_2_COHORTINDEX_H
+
+#include "../header/PercentileIndex.h"
+#include "../header/AnxietyTest.h"
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+
+// Битовая карта номеров строк, разбитая на блоки по 65536 строк, как в roaring.
+// Блок либо отсутствует (в нем нет ни одной строки), либо хранится битовым массивом:
+// строки добавляются в порядке времени, поэтому карты дат - плотные отрезки.
+class RowBitmap {
+public:
+    static constexpr uint64_t chunkRows = 1 << 16;
+    static constexpr size_t chunkWords = chunkRows / 64;
+
+private:
+    std::vector<std::unique_ptr<uint64_t[]>> chunks;
+
+public:
+    void set(uint64_t row) {
+        size_t chunk = row / chunkRows;
+        if (chunks.size() <= chunk) {
+            chunks.resize(chunk + 1);
+        }
+        if (!chunks[chunk]) {
+            chunks[chunk].reset(new uint64_t[chunkWords]());
+        }
+        chunks[chunk][(row % chunkRows) / 64] |= 1ULL << (row % 64);
+    }
+
+    const uint64_t* chunk(size_t index) const {
+        return index < chunks.size() ? chunks[index].get() : nullptr;
+    }
+
+    void clear() {
+        chunks.clear();
+    }
+};
+
+struct CohortFilter {
+    AnxietyBand situational = AnxietyBand::Any;
+    AnxietyBand personal = AnxietyBand::Any;
+    int fromMonth = -1;   // номер месяца по PercentileIndex::cohortOf, -1 - без ограничения
+    int toMonth = -1;
+    bool distinctUsers = false;
+};
+
+struct CohortCount {
+    uint64_t results;
+    uint64_t users;
+};
+
+// Битовые индексы результатов по уровням тревожности обеих шкал и по месяцам плюс
+// столбец пользователей для подсчета различных. Подсчет по фильтру - пересечение
+// карт блок за блоком и popcount.
+class CohortIndex {
+private:
+    std::vector<uint32_t> users;
+    RowBitmap situationalBands[3];
+    RowBitmap personalBands[3];
+    RowBitmap monthBitmaps[PercentileIndex::cohortCount];
+    uint32_t maxUserId = 0;
+
+public:
+    uint64_t size() const {
+        return users.size();
+    }
+
+    void clear() {
+        users.clear();
+        for (int i = 0; i < 3; i++) {
+            situationalBands[i].clear();
+            personalBands[i].clear();
+        }
+        for (RowBitmap& bitmap : monthBitmaps) {
+            bitmap.clear();
+        }
+        maxUserId = 0;
+    }
+
+    void add(uint32_t userId, int situationalScore, int personalScore, int64_t timestamp) {
+        uint64_t row = users.size();
+        int month = PercentileIndex::cohortOf(timestamp);
+        users.push_back(userId);
+        maxUserId = userId > maxUserId ? userId : maxUserId;
+        situationalBands[static_cast<int>(AnxietyTest::band(situationalScore))].set(row);
+        personalBands[static_cast<int>(AnxietyTest::band(personalScore))].set(row);
+        if (month >= 0) {
+            monthBitmaps[month].set(row);
+        }
+    }
+
+    CohortCount count(const CohortFilter& filter) const {
+        CohortCount result {0, 0};
+        bool byMonth = filter.fromMonth >= 0 || filter.toMonth >= 0;
+        int fromMonth = filter.fromMonth >= 0 ? filter.fromMonth : 0;
+        int toMonth = filter.toMonth >= 0 && filter.toMonth < PercentileIndex::cohortCount
+                      ? filter.toMonth : PercentileIndex::cohortCount - 1;
+        std::vector<uint64_t> seen;
+        if (filter.distinctUsers) {
+            seen.resize(maxUserId / 64 + 1);
+        }
+
+        uint64_t rows = size();
+        uint64_t words[RowBitmap::chunkWords];
+        for (size_t chunk = 0; chunk * RowBitmap::chunkRows < rows; chunk++) {
+            const uint64_t* situationalChunk = filter.situational == AnxietyBand::Any ? nullptr
+                    : situationalBands[static_cast<int>(filter.situational)].chunk(chunk);
+            const uint64_t* personalChunk = filter.personal == AnxietyBand::Any ? nullptr
+                    : personalBands[static_cast<int>(filter.personal)].chunk(chunk);
+            if ((filter.situational != AnxietyBand::Any && !situationalChunk) ||
+                (filter.personal != AnxietyBand::Any && !personalChunk)) {
+                continue;
+            }
+
+            uint64_t chunkStart = chunk * RowBitmap::chunkRows;
+            uint64_t chunkEnd = rows - chunkStart < RowBitmap::chunkRows ? rows - chunkStart : RowBitmap::chunkRows;
+            for (size_t w = 0; w < RowBitmap::chunkWords; w++) {
+                uint64_t first = w * 64;
+                words[w] = first >= chunkEnd ? 0 : chunkEnd - first >= 64 ? ~0ULL : (1ULL << (chunkEnd - first)) - 1;
+            }
+            if (byMonth) {
+                bool any = false;
+                uint64_t monthWords[RowBitmap::chunkWords] = {};
+                for (int month = fromMonth; month <= toMonth; month++) {
+                    const uint64_t* monthChunk = monthBitmaps[month].chunk(chunk);
+                    if (monthChunk) {
+                        any = true;
+                        for (size_t w = 0; w < RowBitmap::chunkWords; w++) {
+                            monthWords[w] |= monthChunk[w];
+                        }
+                    }
+                }
+                if (!any) {
+                    continue;
+                }
+                for (size_t w = 0; w < RowBitmap::chunkWords; w++) {
+                    words[w] &= monthWords[w];
+                }
+            }
+            if (situationalChunk) {
+                for (size_t w = 0; w < RowBitmap::chunkWords; w++) {
+                    words[w] &= situationalChunk[w];
+                }
+            }
+            if (personalChunk) {
+                for (size_t w = 0; w < RowBitmap::chunkWords; w++) {
+                    words[w] &= personalChunk[w];
+                }
+            }
+
+            for (size_t w = 0; w < RowBitmap::chunkWords; w++) {
+                result.results += static_cast<uint64_t>(__builtin_popcountll(words[w]));
+                if (filter.distinctUsers) {
+                    for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1) {
+                        uint32_t user = users[chunkStart + w * 64 + static_cast<uint64_t>(__builtin_ctzll(bits))];
+                        uint64_t mask = 1ULL << (user % 64);
+                        if (!(seen[user / 64] & mask)) {
+                            seen[user / 64] |= mask;
+                            result.users++;
+                        }
+                    }
+                }
+            }
+        }
+        return result;
+    }
+};
+
+#endif //LAB_2_COHORTINDEX_H
@@ -0,0 +1,156 @@
+#ifndef LAB_2_PERCENTILEINDEX_H
+#define LAB_2_PERCENTILEINDEX_H
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Баллы обеих шкал - небольшие целые числа (от 19 до 80), поэтому вместо
+// приближенных скетчей (t-digest, KLL) хватает точной гистограммы на 128 значений:
+// она так же сливается сложением, обновляется за O(1) и дает точный процентиль.
+struct ScoreHistogram {
+    static constexpr int bins = 128;
+
+    uint64_t total;
+    uint64_t counts[bins];
+
+    void add(int score) {
+        counts[clamp(score)]++;
+        total++;
+    }
+
+    void merge(const ScoreHistogram& other) {
+        for (int i = 0; i < bins; i++) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+    }
+
+    // Доля результатов ниже score плюс половина равных ему, в процентах.
+    double percentile(int score) const {
+        if (total == 0) {
+            return 0.0;
+        }
+        int bin = clamp(score);
+        uint64_t below = 0;
+        for (int i = 0; i < bin; i++) {
+            below += counts[i];
+        }
+        return 100.0 * (static_cast<double>(below) + counts[bin] / 2.0) / total;
+    }
+
+    static int clamp(int score) {
+        return score < 0 ? 0 : score >= bins ? bins - 1 : score;
+    }
+};
+
+struct CohortHistograms {
+    ScoreHistogram situational;
+    ScoreHistogram personal;
+};
+
+// Гистограммы по всей выборке и по когортам - месяцам прохождения теста.
+// Хранятся в отображаемом файле рядом с индексом результатов.
+class PercentileIndex {
+public:
+    static constexpr int firstYear = 2020;
+    static constexpr int cohortCount = 12 * 50;
+
+private:
+    struct Layout {
+        char magic[8];
+        uint64_t reserved;
+        CohortHistograms population;
+        CohortHistograms cohorts[cohortCount];
+    };
+
+    int fd = -1;
+    Layout* layout = nullptr;
+
+public:
+    // Когорта - номер месяца с января firstYear; -1, если дата неизвестна.
+    static int cohortOf(int64_t timestamp) {
+        if (timestamp <= 0) {
+            return -1;
+        }
+        std::time_t time = static_cast<std::time_t>(timestamp);
+        std::tm date {};
+        gmtime_r(&time, &date);
+        int cohort = (date.tm_year + 1900 - firstYear) * 12 + date.tm_mon;
+        return cohort >= 0 && cohort < cohortCount ? cohort : -1;
+    }
+
+    // Возвращает false, если файл создан заново и его нужно заполнить по сегментам.
+    bool open(const std::string& path) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0600);
+        if (fd < 0 || ftruncate(fd, sizeof(Layout)) < 0) {
+            return false;
+        }
+        void* memory = mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED) {
+            layout = nullptr;
+            return false;
+        }
+        layout = static_cast<Layout*>(memory);
+        if (std::memcmp(layout->magic, "PCTIDX01", 8) != 0) {
+            reset();
+            return false;
+        }
+        return true;
+    }
+
+    ~PercentileIndex() {
+        if (layout) {
+            munmap(layout, sizeof(Layout));
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    bool isOpen() const {
+        return layout != nullptr;
+    }
+
+    void reset() {
+        if (layout) {
+            std::memset(layout, 0, sizeof(Layout));
+            std::memcpy(layout->magic, "PCTIDX01", 8);
+        }
+    }
+
+    void add(int situational, int personal, int64_t timestamp) {
+        if (!layout) {
+            return;
+        }
+        layout->population.situational.add(situational);
+        layout->population.personal.add(personal);
+        int cohort = cohortOf(timestamp);
+        if (cohort >= 0) {
+            layout->cohorts[cohort].situational.add(situational);
+            layout->cohorts[cohort].personal.add(personal);
+        }
+    }
+
+    const CohortHistograms* population() const {
+        return layout ? &layout->population : nullptr;
+    }
+
+    const CohortHistograms* cohort(int index) const {
+        return layout && index >= 0 && index < cohortCount ? &layout->cohorts[index] : nullptr;
+    }
+
+    bool sync() {
+        return layout && msync(layout, sizeof(Layout), MS_SYNC) == 0;
+    }
+
+    int descriptor() const {
+        return layout ? fd : -1;
+    }
+};
+
+#endif //LAB_2_PERCENTILEINDEX_H
@@ -6,6 +6,7 @@
 #define LAB_2_PERSONALANXIETY_H
 
 #include <iostream>
+#include "../header/ScoringEngine.h"
 
 class PersonalAnxietyTest : public AnxietyTest {
 public:
@@ -13,10 +14,7 @@ public:
             : AnxietyTest(numQuestions, questions) {}
 
     int calculateResult() override {
-        int positiveSum = answers[1] + answers[2] + answers[3] + answers[4] + answers[7] + answers[10] + answers[11] + answers[13] + answers[14] + answers[16] + answers[17] + answers[19];
-        int negativeSum = answers[0] + answers[5] + answers[6] + answers[9] + answers[12] + answers[15] + answers[18];
-        int result = positiveSum - negativeSum + 35;
-        return result;
+        return Instrument::personal().score(answers.data());
     }
 };
 
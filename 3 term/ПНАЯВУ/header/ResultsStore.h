@@ -0,0 +1,406 @@
+#ifndef LAB_2_RESULTSSTORE_H
+#define LAB_2_RESULTSSTORE_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include "../header/PercentileIndex.h"
+#include "../header/CohortIndex.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct ResultRecord {
+    uint32_t userId;
+    int16_t situational;
+    int16_t personal;
+    int64_t timestamp;
+    uint64_t previous;
+    uint64_t reserved;
+};
+
+struct ScoreAggregate {
+    static constexpr uint32_t recentSize = 8;
+
+    int64_t sum;
+    int64_t sumSquares;
+    int16_t min;
+    int16_t max;
+    int16_t recent[recentSize];
+    uint32_t reserved;
+
+    void add(int score, uint64_t count) {
+        if (count == 0 || score < min) {
+            min = static_cast<int16_t>(score);
+        }
+        if (count == 0 || score > max) {
+            max = static_cast<int16_t>(score);
+        }
+        sum += score;
+        sumSquares += static_cast<int64_t>(score) * score;
+        recent[count % recentSize] = static_cast<int16_t>(score);
+    }
+
+    double mean(uint64_t count) const {
+        return count ? static_cast<double>(sum) / count : 0.0;
+    }
+
+    double variance(uint64_t count) const {
+        if (count < 2) {
+            return 0.0;
+        }
+        double average = mean(count);
+        return (static_cast<double>(sumSquares) - average * average * count) / (count - 1);
+    }
+
+    // Наклон прямой по последним recentSize результатам: баллов за тест.
+    double trend(uint64_t count) const {
+        uint64_t n = count < recentSize ? count : recentSize;
+        if (n < 2) {
+            return 0.0;
+        }
+        double sumX = 0, sumY = 0, sumXY = 0, sumXX = 0;
+        for (uint64_t i = 0; i < n; i++) {
+            double y = recent[(count - n + i) % recentSize];
+            sumX += i;
+            sumY += y;
+            sumXY += i * y;
+            sumXX += static_cast<double>(i) * i;
+        }
+        return (n * sumXY - sumX * sumY) / (n * sumXX - sumX * sumX);
+    }
+};
+
+struct UserResultsEntry {
+    uint64_t last;
+    uint64_t count;
+    ScoreAggregate situational;
+    ScoreAggregate personal;
+};
+
+struct ResultsIndexHeader {
+    char magic[8];
+    uint64_t records;
+    uint64_t users;
+    uint64_t cleanRecords;   // records + 1, если файлы сброшены при закрытии и с тех пор не менялись
+};
+
+class ResultsStore {
+private:
+    static constexpr uint64_t recordsPerSegment = 1 << 20;
+    static constexpr uint64_t initialUsers = 1024;
+
+    std::string directory;
+    std::vector<int> segments;
+    int indexFd = -1;
+    size_t indexSize = 0;
+    ResultsIndexHeader* header = nullptr;
+    UserResultsEntry* entries = nullptr;
+    PercentileIndex percentiles;
+    CohortIndex cohorts;
+    bool cohortsLoaded = false;
+
+    static size_t indexFileSize(uint64_t users) {
+        return sizeof(ResultsIndexHeader) + users * sizeof(UserResultsEntry);
+    }
+
+    std::string segmentPath(uint64_t segment) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "results.%04llu.log", static_cast<unsigned long long>(segment));
+        return directory + name;
+    }
+
+    // Сегмент создается только при записи: чтение отсутствующего сегмента не должно
+    // оставлять пустой файл.
+    int segmentFd(uint64_t segment, bool create = false) {
+        while (segments.size() <= segment) {
+            segments.push_back(-1);
+        }
+        if (segments[segment] < 0) {
+            segments[segment] = ::open(segmentPath(segment).c_str(), O_RDWR | (create ? O_CREAT : 0), 0600);
+        }
+        return segments[segment];
+    }
+
+    bool mapIndex(uint64_t users) {
+        if (header) {
+            munmap(header, indexSize);
+        }
+        if (ftruncate(indexFd, indexFileSize(users)) < 0) {
+            header = nullptr;
+            return false;
+        }
+        void* memory = mmap(nullptr, indexFileSize(users), PROT_READ | PROT_WRITE, MAP_SHARED, indexFd, 0);
+        if (memory == MAP_FAILED) {
+            header = nullptr;
+            return false;
+        }
+        indexSize = indexFileSize(users);
+        header = static_cast<ResultsIndexHeader*>(memory);
+        entries = reinterpret_cast<UserResultsEntry*>(header + 1);
+        header->users = users;
+        return true;
+    }
+
+    bool ensureUser(uint32_t userId) {
+        if (userId < header->users) {
+            return true;
+        }
+        uint64_t users = header->users;
+        while (users <= userId) {
+            users *= 2;
+        }
+        return mapIndex(users);
+    }
+
+    void index(uint32_t userId, uint64_t number, const ResultRecord& record) {
+        UserResultsEntry& entry = entries[userId];
+        entry.situational.add(record.situational, entry.count);
+        entry.personal.add(record.personal, entry.count);
+        entry.last = number + 1;
+        entry.count++;
+        percentiles.add(record.situational, record.personal, record.timestamp);
+        if (cohortsLoaded) {
+            cohorts.add(userId, record.situational, record.personal, record.timestamp);
+        }
+    }
+
+    // Пересчитывает индекс по первым limit записям сегментов (индекс старого формата
+    // не содержит агрегатов; после сбоя индекс может опережать сегменты).
+    bool rebuildIndex(uint64_t limit = UINT64_MAX) {
+        std::memset(entries, 0, header->users * sizeof(UserResultsEntry));
+        header->records = 0;
+        header->cleanRecords = 0;
+        percentiles.reset();
+        cohorts.clear();
+        cohortsLoaded = false;
+        ResultRecord record {};
+        for (uint64_t number = 0; number < limit && readRecord(number, record); number++) {
+            if (!ensureUser(record.userId)) {
+                return false;
+            }
+            header->records = number + 1;
+            index(record.userId, number, record);
+        }
+        std::memcpy(header->magic, "RESIDX02", 8);
+        return true;
+    }
+
+    void rebuildPercentiles() {
+        percentiles.reset();
+        ResultRecord record {};
+        for (uint64_t number = 0; number < header->records && readRecord(number, record); number++) {
+            percentiles.add(record.situational, record.personal, record.timestamp);
+        }
+    }
+
+    // Битовые карты и столбец пользователей строятся при первом запросе одним проходом
+    // по сегментам крупными блоками, а дальше пополняются при каждой записи.
+    void loadCohorts() {
+        cohorts.clear();
+        std::vector<ResultRecord> block(1 << 16);
+        for (uint64_t number = 0; number < header->records;) {
+            uint64_t segment = number / recordsPerSegment;
+            uint64_t inSegment = number % recordsPerSegment;
+            uint64_t wanted = std::min<uint64_t>({block.size(), recordsPerSegment - inSegment,
+                                                  header->records - number});
+            int fd = segmentFd(segment);
+            ssize_t got = fd < 0 ? -1 : pread(fd, block.data(), wanted * sizeof(ResultRecord),
+                                               static_cast<off_t>(inSegment * sizeof(ResultRecord)));
+            if (got < static_cast<ssize_t>(sizeof(ResultRecord))) {
+                break;
+            }
+            uint64_t read = static_cast<uint64_t>(got) / sizeof(ResultRecord);
+            for (uint64_t i = 0; i < read; i++) {
+                cohorts.add(block[i].userId, block[i].situational, block[i].personal, block[i].timestamp);
+            }
+            number += read;
+        }
+        cohortsLoaded = true;
+    }
+
+    bool readRecord(uint64_t number, ResultRecord& record) {
+        int fd = segmentFd(number / recordsPerSegment);
+        off_t offset = static_cast<off_t>((number % recordsPerSegment) * sizeof(ResultRecord));
+        return fd >= 0 && pread(fd, &record, sizeof(record), offset) == sizeof(record);
+    }
+
+public:
+    explicit ResultsStore(const std::string& directory = "") : directory(directory) {
+        indexFd = ::open((directory + "results.idx").c_str(), O_RDWR | O_CREAT, 0600);
+        if (indexFd < 0) {
+            std::cout << "Не удалось открыть хранилище результатов\n";
+            return;
+        }
+        struct stat st {};
+        fstat(indexFd, &st);
+        uint64_t users = initialUsers;
+        if (st.st_size > static_cast<off_t>(sizeof(ResultsIndexHeader))) {
+            users = (st.st_size - sizeof(ResultsIndexHeader)) / sizeof(UserResultsEntry);
+        }
+        if (users < initialUsers) {
+            users = initialUsers;
+        }
+        if (!mapIndex(users)) {
+            std::cout << "Не удалось открыть хранилище результатов\n";
+            return;
+        }
+        bool percentilesReady = percentiles.open(directory + "percentiles.idx");
+        if (std::memcmp(header->magic, "RESIDX02", 8) == 0) {
+            if (!percentilesReady) {
+                rebuildPercentiles();
+            }
+            return;
+        }
+        // Индекс старого формата, чужой или потерянный при существующих сегментах
+        // восстанавливается по ним, иначе новые результаты затерли бы историю с нулевой записи.
+        if (std::memcmp(header->magic, "RESIDX01", 8) == 0 || access(segmentPath(0).c_str(), F_OK) == 0) {
+            if (!rebuildIndex()) {
+                std::cout << "Не удалось перестроить индекс результатов\n";
+            }
+            return;
+        }
+        std::memcpy(header->magic, "RESIDX02", 8);
+        header->records = 0;
+        percentiles.reset();
+    }
+
+    ~ResultsStore() {
+        if (header) {
+            munmap(header, indexSize);
+        }
+        if (indexFd >= 0) {
+            ::close(indexFd);
+        }
+        for (int fd : segments) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+    }
+
+    ResultsStore(const ResultsStore&) = delete;
+    ResultsStore& operator=(const ResultsStore&) = delete;
+
+    bool isOpen() const {
+        return header != nullptr;
+    }
+
+    bool append(uint32_t userId, int situational, int personal, int64_t timestamp) {
+        if (!header || !ensureUser(userId)) {
+            return false;
+        }
+        uint64_t number = header->records;
+        ResultRecord record {};
+        record.userId = userId;
+        record.situational = static_cast<int16_t>(situational);
+        record.personal = static_cast<int16_t>(personal);
+        record.timestamp = timestamp;
+        record.previous = entries[userId].last;
+
+        int fd = segmentFd(number / recordsPerSegment, true);
+        off_t offset = static_cast<off_t>((number % recordsPerSegment) * sizeof(ResultRecord));
+        if (fd < 0 || pwrite(fd, &record, sizeof(record), offset) != sizeof(record)) {
+            return false;
+        }
+        header->records = number + 1;
+        index(userId, number, record);
+        return true;
+    }
+
+    uint64_t records() const {
+        return header ? header->records : 0;
+    }
+
+    // Файлы, которые нужно сбросить для контрольной точки. fdatasync по дескриптору
+    // сбрасывает и страницы, измененные через отображение, поэтому его можно делать
+    // без блокировки, пока индекс переотображается или дописывается.
+    bool syncTargets(std::vector<int>& fds) const {
+        if (!header || percentiles.descriptor() < 0) {
+            return false;
+        }
+        fds.push_back(indexFd);
+        fds.push_back(percentiles.descriptor());
+        for (int fd : segments) {
+            if (fd >= 0) {
+                fds.push_back(fd);
+            }
+        }
+        return true;
+    }
+
+    // Отметка чистого закрытия ставится после сброса всех файлов результатов.
+    bool markClean() {
+        if (!header) {
+            return false;
+        }
+        header->cleanRecords = header->records + 1;
+        return fdatasync(indexFd) == 0;
+    }
+
+    // Снимает отметку и возвращает, совпадали ли файлы на диске ровно с records
+    // записями. Отметка снимается на диске до любого изменения: иначе сбой посреди
+    // восстановления оставил бы ее на уже измененных файлах.
+    bool takeCleanMark(uint64_t records) {
+        if (!header) {
+            return false;
+        }
+        bool clean = header->cleanRecords == records + 1 && header->records == records;
+        header->cleanRecords = 0;
+        return fdatasync(indexFd) == 0 && clean;
+    }
+
+    // Откат к состоянию контрольной точки: все, что записано после нее, будет
+    // заново добавлено из журнала. Страницы отображенного индекса могли попасть на
+    // диск в любой момент после точки, поэтому откатить его по хвосту нельзя:
+    // индекс и перцентили пересчитываются по всем checkpointRecords записям
+    // сегментов, и время запуска после сбоя растет с общим числом результатов.
+    bool recover(uint64_t checkpointRecords) {
+        return header && rebuildIndex(checkpointRecords);
+    }
+
+    uint64_t count(uint32_t userId) const {
+        return header && userId < header->users ? entries[userId].count : 0;
+    }
+
+    std::vector<ResultRecord> history(uint32_t userId) {
+        std::vector<ResultRecord> records;
+        if (!header || userId >= header->users) {
+            return records;
+        }
+        records.reserve(entries[userId].count);
+        ResultRecord record {};
+        for (uint64_t next = entries[userId].last; next != 0; next = record.previous) {
+            if (!readRecord(next - 1, record)) {
+                break;
+            }
+            records.push_back(record);
+        }
+        return std::vector<ResultRecord>(records.rbegin(), records.rend());
+    }
+
+    const PercentileIndex& percentileIndex() const {
+        return percentiles;
+    }
+
+    CohortCount countCohort(const CohortFilter& filter) {
+        if (!header) {
+            return CohortCount {0, 0};
+        }
+        if (!cohortsLoaded) {
+            loadCohorts();
+        }
+        return cohorts.count(filter);
+    }
+
+    const UserResultsEntry* summary(uint32_t userId) const {
+        return header && userId < header->users && entries[userId].count ? &entries[userId] : nullptr;
+    }
+};
+
+#endif //LAB_2_RESULTSSTORE_H
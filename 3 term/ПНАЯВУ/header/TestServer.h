@@ -0,0 +1,547 @@
+#ifndef LAB_2_TESTSERVER_H
+#define LAB_2_TESTSERVER_H
+
+#include "../header/UserManager.h"
+#include "../header/SituationalAnxietyTest.h"
+#include "../header/PersonalAnxietyTest.h"
+#include "../header/globalFuncs.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+// Сервер тестирования: однопоточный цикл на epoll, у каждого клиента свой автомат
+// состояний, который ведет его по тем же вопросам, что и консольная версия.
+// Протокол построчный: сервер присылает вопрос, клиент отвечает строкой.
+// Для нескольких ядер запускается по серверу на поток: порт открывается с SO_REUSEPORT,
+// и ядро само распределяет подключения между циклами.
+// Цикл никогда не ждет fdatasync: регистрация и результат теста только записываются
+// в журнал, фиксацию ждет поток committer, а ответ клиенту отправляется, когда тот
+// сообщит через eventfd. Пока фиксация не завершена, строки клиента не читаются.
+class TestServer {
+private:
+    static constexpr size_t maxLineLength = 1024;
+    static constexpr int maxEvents = 256;
+
+    enum class State {
+        Menu,
+        RegisterName,
+        RegisterPassword,
+        LoginName,
+        LoginPassword,
+        Actions,
+        Situational,
+        Personal
+    };
+
+    struct Session {
+        int fd;
+        State state = State::Menu;
+        std::string input;
+        std::string output;
+        std::string username;
+        int question = 0;
+        SituationalAnxietyTest situational;
+        PersonalAnxietyTest personal;
+        bool closing = false;
+        uint64_t serial;
+        bool committing = false;
+        std::string deferred;   // вывод, который уйдет клиенту после фиксации
+        uint32_t events = EPOLLIN | EPOLLRDHUP;
+
+        Session(int fd, uint64_t serial, const std::vector<std::string>& situationalQuestions,
+                const std::vector<std::string>& personalQuestions)
+                : fd(fd), situational(static_cast<int>(situationalQuestions.size()), situationalQuestions),
+                  personal(static_cast<int>(personalQuestions.size()), personalQuestions), serial(serial) {}
+    };
+
+    // Ожидающая фиксации запись журнала. Дескриптор мог быть закрыт и выдан новому
+    // клиенту, поэтому сессия узнается еще и по serial.
+    struct PendingCommit {
+        int fd;
+        uint64_t serial;
+        uint64_t lsn;
+        bool registration;
+        std::string username;
+        bool durable;
+    };
+
+    UserManager& userManager;
+    uint16_t port;
+    uint32_t address;
+    int listenFd = -1;
+    int epollFd = -1;
+    int wakeFd = -1;
+    uint64_t nextSerial = 0;
+    std::vector<std::string> situationalQuestions;
+    std::vector<std::string> personalQuestions;
+    std::unordered_map<int, std::unique_ptr<Session>> sessions;
+
+    std::mutex commitMutex;
+    std::condition_variable commitWake;
+    std::vector<PendingCommit> queued;
+    std::vector<PendingCommit> completed;
+    bool stopping = false;
+    std::thread committer;
+
+    void send(Session& session, const std::string& text) {
+        session.output += text;
+    }
+
+    void sendMenu(Session& session) {
+        send(session, "1. Регистрация\n2. Вход\nВыберите действие: \n");
+        session.state = State::Menu;
+    }
+
+    void sendActions(Session& session) {
+        send(session, "\nЧто вы хотите сделать?\n1. Пройти тест\n2. Просмотреть историю тестов\n3. Выход\nВыберите действие: \n");
+        session.state = State::Actions;
+    }
+
+    void sendQuestion(Session& session, const AnxietyTest& test) {
+        send(session, "Вопрос " + std::to_string(session.question + 1) + ": " + test.question(session.question) +
+                      "\nВаш ответ (1-4): \n");
+    }
+
+    void sendHistory(Session& session) {
+        std::vector<ResultRecord> history = userManager.testHistory(session.username);
+        if (history.empty()) {
+            send(session, "История тестов не найдена.\n");
+            return;
+        }
+        send(session, "История тестов для пользователя " + session.username + ":\n");
+        for (const ResultRecord& record : history) {
+            send(session, std::to_string(record.situational) + " " + std::to_string(record.personal) + "\n");
+        }
+    }
+
+    // Незафиксированная регистрация убирается здесь же, даже если клиент уже отключился.
+    void runCommitter() {
+        std::unique_lock<std::mutex> lock(commitMutex);
+        for (;;) {
+            commitWake.wait(lock, [this] { return stopping || !queued.empty(); });
+            if (queued.empty()) {
+                return;
+            }
+            std::vector<PendingCommit> batch;
+            batch.swap(queued);
+            lock.unlock();
+            for (PendingCommit& commit : batch) {
+                commit.durable = userManager.waitDurable(commit.lsn);
+                if (commit.registration) {
+                    userManager.finishRegistration(commit.username, commit.durable);
+                }
+            }
+            lock.lock();
+            completed.insert(completed.end(), batch.begin(), batch.end());
+            uint64_t one = 1;
+            if (::write(wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+                std::cout << "Не удалось разбудить цикл событий\n";
+            }
+        }
+    }
+
+    void awaitCommit(Session& session, uint64_t lsn, bool registration) {
+        session.committing = true;
+        {
+            std::lock_guard<std::mutex> lock(commitMutex);
+            queued.push_back(PendingCommit {session.fd, session.serial, lsn, registration, session.username, false});
+        }
+        commitWake.notify_one();
+    }
+
+    void completeCommit(Session& session, const PendingCommit& commit) {
+        session.committing = false;
+        if (commit.registration) {
+            send(session, commit.durable ? "Регистрация успешна!\n" : "Не удалось сохранить пользователя.\n");
+            sendMenu(session);
+            return;
+        }
+        if (!commit.durable) {
+            send(session, "Не удалось сохранить результат теста.\n");
+        }
+        send(session, session.deferred);
+        session.deferred.clear();
+        sendActions(session);
+    }
+
+    void finishTest(Session& session) {
+        int situationalScore = session.situational.calculateResult();
+        int personalScore = session.personal.calculateResult();
+        uint64_t lsn;
+        bool logged = userManager.logResult(session.username, situationalScore, personalScore,
+                                            std::time(nullptr), lsn);
+        if (!logged) {
+            send(session, "Не удалось сохранить результат теста.\n");
+        }
+
+        std::string text;
+        text += "Ситуативная тревожность: " + std::to_string(situationalScore) + ". " +
+                AnxietyTest::resultDescription(situationalScore) + "\n";
+        text += "Личностная тревожность: " + std::to_string(personalScore) + ". " +
+                AnxietyTest::resultDescription(personalScore) + "\n";
+
+        PopulationRank rank {};
+        if (userManager.populationRank(situationalScore, personalScore, std::time(nullptr), rank)) {
+            char line[160];
+            std::snprintf(line, sizeof(line), "Выше, чем у %.1f%% / %.1f%% из %llu прошедших тест\n",
+                          rank.situational, rank.personal, static_cast<unsigned long long>(rank.population));
+            text += line;
+        }
+
+        UserResultsEntry summary;
+        if (userManager.resultSummary(session.username, summary) && summary.count > 1) {
+            int64_t count = static_cast<int64_t>(summary.count);
+            text += "Среднее по всем тестам: " + std::to_string(summary.situational.sum / count) + " / " +
+                    std::to_string(summary.personal.sum / count) + "\n";
+        }
+        if (logged) {
+            session.deferred = text;
+            awaitCommit(session, lsn, false);
+            return;
+        }
+        send(session, text);
+        sendActions(session);
+    }
+
+    void handleLine(Session& session, const std::string& line) {
+        switch (session.state) {
+            case State::Menu:
+                if (line == "1") {
+                    send(session, "Введите имя пользователя: \n");
+                    session.state = State::RegisterName;
+                } else if (line == "2") {
+                    send(session, "Введите имя пользователя: \n");
+                    session.state = State::LoginName;
+                } else {
+                    send(session, "Некорректный выбор.\n");
+                    sendMenu(session);
+                }
+                break;
+            case State::RegisterName:
+            case State::LoginName:
+                session.username = line;
+                send(session, session.state == State::RegisterName ? "Введите пароль (8 символов): \n"
+                                                                    : "Введите пароль: \n");
+                session.state = session.state == State::RegisterName ? State::RegisterPassword : State::LoginPassword;
+                break;
+            case State::RegisterPassword:
+                if (line.length() != 8) {
+                    send(session, "Пароль должен содержать ровно 8 символов.\n");
+                } else {
+                    uint64_t lsn;
+                    switch (userManager.beginRegistration(session.username, line, lsn)) {
+                        case RegisterStatus::Ok:
+                            awaitCommit(session, lsn, true);
+                            return;
+                        case RegisterStatus::Exists:
+                            send(session, "Пользователь с таким именем уже существует.\n");
+                            break;
+                        case RegisterStatus::TooLong:
+                            send(session, "Имя пользователя слишком длинное.\n");
+                            break;
+                        default:
+                            send(session, "Не удалось сохранить пользователя.\n");
+                            break;
+                    }
+                }
+                sendMenu(session);
+                break;
+            case State::LoginPassword:
+                if (userManager.checkCredentials(session.username, line)) {
+                    send(session, "Добро пожаловать, " + session.username + "!\n");
+                    sendActions(session);
+                } else {
+                    send(session, "Неверное имя пользователя или пароль.\n");
+                    sendMenu(session);
+                }
+                break;
+            case State::Actions:
+                if (line == "1") {
+                    send(session, "Тест на ситуативную тревожность:\n"
+                                  "Ответьте на следующие вопросы, выбрав цифру от 1 до 4\n"
+                                  "(1 - нет, это не совсем так; 2 - пожалуй, так; 3 - верно; 4 - совершенно верно):\n");
+                    session.question = 0;
+                    session.state = State::Situational;
+                    sendQuestion(session, session.situational);
+                } else if (line == "2") {
+                    sendHistory(session);
+                    sendActions(session);
+                } else if (line == "3") {
+                    session.closing = true;
+                } else {
+                    sendActions(session);
+                }
+                break;
+            case State::Situational:
+            case State::Personal: {
+                AnxietyTest& test = session.state == State::Situational
+                                    ? static_cast<AnxietyTest&>(session.situational)
+                                    : static_cast<AnxietyTest&>(session.personal);
+                if (line.size() != 1 || !test.setAnswer(session.question, line[0] - '0')) {
+                    send(session, "Ошибка! Введите число от 1 до 4.\n");
+                    sendQuestion(session, test);
+                    break;
+                }
+                if (++session.question < test.size()) {
+                    sendQuestion(session, test);
+                } else if (session.state == State::Situational) {
+                    send(session, "\nТест на личностную тревожность:\n");
+                    session.question = 0;
+                    session.state = State::Personal;
+                    sendQuestion(session, session.personal);
+                } else {
+                    finishTest(session);
+                }
+                break;
+            }
+        }
+    }
+
+    void closeSession(int fd) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        sessions.erase(fd);
+    }
+
+    void updateInterest(Session& session) {
+        uint32_t events = session.closing ? (session.output.empty() ? 0u : static_cast<uint32_t>(EPOLLOUT))
+                                          : (static_cast<uint32_t>(EPOLLRDHUP) |
+                                             (session.committing ? 0u : static_cast<uint32_t>(EPOLLIN)) |
+                                             (session.output.empty() ? 0u : static_cast<uint32_t>(EPOLLOUT)));
+        if (events == session.events) {
+            return;
+        }
+        session.events = events;
+        epoll_event event {};
+        event.events = events;
+        event.data.fd = session.fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, session.fd, &event);
+    }
+
+    bool flush(Session& session) {
+        while (!session.output.empty()) {
+            ssize_t written = ::send(session.fd, session.output.data(), session.output.size(), MSG_NOSIGNAL);
+            if (written < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            session.output.erase(0, static_cast<size_t>(written));
+        }
+        return true;
+    }
+
+    void acceptClients() {
+        for (;;) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            auto session = std::make_unique<Session>(fd, ++nextSerial, situationalQuestions, personalQuestions);
+            send(*session, "Добро пожаловать в тест на тревожность!\n");
+            sendMenu(*session);
+
+            epoll_event event {};
+            event.events = EPOLLIN | EPOLLRDHUP;
+            event.data.fd = fd;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+            Session& ref = *session;
+            sessions[fd] = std::move(session);
+            if (!flush(ref)) {
+                closeSession(fd);
+            } else {
+                updateInterest(ref);
+            }
+        }
+    }
+
+    void processInput(Session& session) {
+        size_t start = 0;
+        for (size_t newline; !session.committing && (newline = session.input.find('\n', start)) != std::string::npos;
+             start = newline + 1) {
+            std::string line = session.input.substr(start, newline - start);
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            handleLine(session, line);
+        }
+        session.input.erase(0, start);
+        if (!session.committing && session.input.size() > maxLineLength) {
+            session.closing = true;
+        }
+    }
+
+    // Отправляет накопленный вывод; false - сессия закрыта. Клиент, закрывший только
+    // свою сторону, еще получит ответ на строку, ждущую фиксации.
+    bool settle(Session& session, uint32_t events) {
+        if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+            session.closing = true;
+        }
+        if (!flush(session) || (session.closing && session.output.empty() && !session.committing) ||
+            (events & (EPOLLHUP | EPOLLERR))) {
+            closeSession(session.fd);
+            return false;
+        }
+        updateInterest(session);
+        return true;
+    }
+
+    void completeCommits() {
+        uint64_t count;
+        while (::read(wakeFd, &count, sizeof(count)) > 0) {
+        }
+        std::vector<PendingCommit> done;
+        {
+            std::lock_guard<std::mutex> lock(commitMutex);
+            done.swap(completed);
+        }
+        for (const PendingCommit& commit : done) {
+            auto it = sessions.find(commit.fd);
+            if (it == sessions.end() || it->second->serial != commit.serial) {
+                continue;
+            }
+            // Пока шла фиксация, сокет не читался; если клиент успел закрыть свою
+            // сторону, его последние строки еще лежат в буфере ядра.
+            Session& session = *it->second;
+            completeCommit(session, commit);
+            if (session.closing) {
+                receive(session);
+            }
+            processInput(session);
+            settle(session, 0);
+        }
+    }
+
+    void receive(Session& session) {
+        char buffer[4096];
+        for (;;) {
+            ssize_t got = ::recv(session.fd, buffer, sizeof(buffer), 0);
+            if (got > 0) {
+                session.input.append(buffer, static_cast<size_t>(got));
+                continue;
+            }
+            if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                session.closing = true;
+            }
+            break;
+        }
+    }
+
+    void serveClient(Session& session, uint32_t events) {
+        if ((events & EPOLLIN) && !session.closing && !session.committing) {
+            receive(session);
+            processInput(session);
+        }
+        settle(session, events);
+    }
+
+public:
+    // По умолчанию сервер слушает только локальный адрес: пароли идут открытым текстом.
+    TestServer(UserManager& userManager, uint16_t port, uint32_t address = INADDR_LOOPBACK)
+            : userManager(userManager), port(port), address(address),
+              situationalQuestions(getQuestions("situational")), personalQuestions(getQuestions("personal")) {}
+
+    ~TestServer() {
+        if (committer.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(commitMutex);
+                stopping = true;
+            }
+            commitWake.notify_one();
+            committer.join();
+        }
+        if (wakeFd >= 0) {
+            ::close(wakeFd);
+        }
+        for (auto& entry : sessions) {
+            ::close(entry.first);
+        }
+        if (epollFd >= 0) {
+            ::close(epollFd);
+        }
+        if (listenFd >= 0) {
+            ::close(listenFd);
+        }
+    }
+
+    TestServer(const TestServer&) = delete;
+    TestServer& operator=(const TestServer&) = delete;
+
+    bool run() {
+        std::signal(SIGPIPE, SIG_IGN);
+        listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) {
+            std::cout << "Не удалось создать сокет\n";
+            return false;
+        }
+        int one = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+        sockaddr_in listenAddress {};
+        listenAddress.sin_family = AF_INET;
+        listenAddress.sin_addr.s_addr = htonl(address);
+        listenAddress.sin_port = htons(port);
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&listenAddress), sizeof(listenAddress)) < 0 ||
+            listen(listenFd, SOMAXCONN) < 0) {
+            std::cout << "Не удалось открыть порт " << port << "\n";
+            return false;
+        }
+
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.fd = listenFd;
+        if (epollFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) < 0) {
+            std::cout << "Не удалось запустить цикл событий\n";
+            return false;
+        }
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        event.data.fd = wakeFd;
+        if (wakeFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) < 0) {
+            std::cout << "Не удалось запустить цикл событий\n";
+            return false;
+        }
+        committer = std::thread(&TestServer::runCommitter, this);
+
+        epoll_event events[maxEvents];
+        for (;;) {
+            int ready = epoll_wait(epollFd, events, maxEvents, -1);
+            if (ready < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            for (int i = 0; i < ready; i++) {
+                int fd = events[i].data.fd;
+                if (fd == listenFd) {
+                    acceptClients();
+                    continue;
+                }
+                if (fd == wakeFd) {
+                    completeCommits();
+                    continue;
+                }
+                auto it = sessions.find(fd);
+                if (it != sessions.end()) {
+                    serveClient(*it->second, events[i].events);
+                }
+            }
+        }
+    }
+};
+
+#endif //LAB_2_TESTSERVER_H
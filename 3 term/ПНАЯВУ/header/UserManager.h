@@ -6,53 +6,353 @@
 #define LAB_2_USERMANAGER_H
 
 #include "../header/UserManager.h"
-#include <unordered_map>
+#include "../header/UserStore.h"
+#include "../header/ResultsStore.h"
+#include "../header/WriteAheadLog.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cstdio>
+#include <ctime>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <unistd.h>
 
 struct User {
     std::string username;
     std::string password;
 };
 
+struct PopulationRank {
+    double situational;
+    double personal;
+    uint64_t population;
+    double cohortSituational;
+    double cohortPersonal;
+    uint64_t cohortSize;
+};
+
+enum class RegisterStatus {
+    Ok,
+    Exists,
+    TooLong,
+    Failed
+};
+
+// Пользователи разложены по shardCount хранилищам по хешу имени; у каждого свой
+// shared_mutex, поэтому входы читают параллельно, а регистрация блокирует один шард.
+// Каждое изменение записывается в журнал journal.NNNNNN.wal; хранилища сбрасываются
+// на диск в контрольных точках, которые фоновый поток делает раз в checkpointInterval
+// или когда журнал вырастает больше checkpointThreshold.
 class UserManager {
 private:
-    std::unordered_map<std::string, User> users;
+    static constexpr uint32_t shardCount = 16;
+    static constexpr uint64_t checkpointThreshold = 64 * 1024 * 1024;
+    static constexpr std::chrono::seconds checkpointInterval{60};
+
+    struct Shard {
+        std::shared_mutex mutex;
+        std::unique_ptr<UserStore> store;
+    };
+
+    Shard shards[shardCount];
+    std::mutex resultsMutex;
+    ResultsStore results;
+    WriteAheadLog wal;
+
+    std::mutex checkpointMutex;
+    std::mutex checkpointerMutex;
+    std::condition_variable checkpointerWake;
+    bool checkpointRequested = false;
+    bool stopping = false;
+    std::thread checkpointer;
+
+    Shard& shardFor(const std::string& username) {
+        return shards[(UserStore::hashName(username) >> 32) % shardCount];
+    }
 
-    void loadUsers() {
+    bool lookupId(const std::string& username, uint32_t& id) {
+        Shard& shard = shardFor(username);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        const UserSlot* user = shard.store->find(username);
+        if (user == nullptr) {
+            return false;
+        }
+        id = user->id;
+        return true;
+    }
+
+    uint64_t userCount() {
+        uint64_t count = 0;
+        for (Shard& shard : shards) {
+            count += shard.store->size();
+        }
+        return count;
+    }
+
+    // Переносит общий users.idx в шарды, сохраняя идентификаторы (на них ссылаются результаты).
+    bool importSingleStore() {
+        if (access("users.idx", F_OK) != 0) {
+            return false;
+        }
+        UserStore legacy("users.idx");
+        uint32_t maxId = 0;
+        legacy.forEach([this, &legacy, &maxId](const UserSlot& slot) {
+            std::string name = legacy.name(slot);
+            shardFor(name).store->restore(name, std::string(slot.password, slot.passwordLength), slot.id);
+            maxId = slot.id > maxId ? slot.id : maxId;
+        });
+        for (Shard& shard : shards) {
+            shard.store->reserveIds(maxId);
+        }
+        checkpoint();
+        std::rename("users.idx", "users.idx.old");
+        std::cout << "Перенесено пользователей из users.idx: " << userCount() << "\n";
+        return true;
+    }
+
+    void importLegacyUsers() {
         std::ifstream file("users.txt");
+        if (!file.is_open()) {
+            return;
+        }
         std::string username, password;
         while (file >> username >> password) {
-            users[username] = {username, password};
+            shardFor(username).store->insert(username, password);
         }
         file.close();
+        std::cout << "Импортировано пользователей из users.txt: " << userCount() << "\n";
     }
 
-    void saveUser(const User& user) {
-        std::ofstream file("users.txt", std::ios::app);
-        file << user.username << " " << user.password << "\n";
+    void importLegacyResults(const std::string& username, uint32_t id) {
+        if (results.count(id) != 0) {
+            return;
+        }
+        std::string path = username + "_results.txt";
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            return;
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream iss(line);
+            int situational, personal;
+            if (iss >> situational >> personal) {
+                results.append(id, situational, personal, 0);
+                wal.logResult(id, situational, personal, 0);
+            }
+        }
         file.close();
+        if (wal.commitAll()) {
+            std::remove(path.c_str());
+        }
+    }
+
+    // Повторяет изменения, сделанные после последней контрольной точки. Результаты
+    // откатываются к точке и добавляются заново, регистрации с известным id идемпотентны.
+    // Число записей в заголовке индекса ничего не доказывает: страницы индекса и
+    // перцентилей могли попасть на диск раньше заголовка. Индекс не трогается только
+    // после чистой остановки, когда отметка совпадает с точкой; после сбоя откат
+    // читает все сегменты (см. ResultsStore::recover).
+    void recover() {
+        bool checked = false;
+        uint64_t replayed = wal.replay(
+                [this, &checked](uint64_t checkpointResults) {
+                    checked = true;
+                    if (!results.takeCleanMark(checkpointResults)) {
+                        results.recover(checkpointResults);
+                    }
+                },
+                [this](uint32_t id, const std::string& username, const std::string& password) {
+                    shardFor(username).store->restore(username, password, id);
+                },
+                [this](uint32_t userId, int situational, int personal, int64_t timestamp) {
+                    results.append(userId, situational, personal, timestamp);
+                });
+        if (!checked) {
+            results.takeCleanMark(results.records());
+        }
+        if (replayed > 0) {
+            std::cout << "Восстановлено записей из журнала: " << replayed << "\n";
+        }
+    }
+
+    void maybeCheckpoint() {
+        if (wal.size() > checkpointThreshold) {
+            {
+                std::lock_guard<std::mutex> lock(checkpointerMutex);
+                checkpointRequested = true;
+            }
+            checkpointerWake.notify_one();
+        }
+    }
+
+    void runCheckpointer() {
+        std::unique_lock<std::mutex> lock(checkpointerMutex);
+        while (!stopping) {
+            checkpointerWake.wait_for(lock, checkpointInterval, [this] { return checkpointRequested || stopping; });
+            if (stopping) {
+                break;
+            }
+            checkpointRequested = false;
+            lock.unlock();
+            checkpoint();
+            lock.lock();
+        }
     }
 
 public:
-    UserManager() {
-        loadUsers();
+    explicit UserManager(Durability durability = Durability::Group,
+                         std::chrono::microseconds commitDelay = std::chrono::microseconds(0))
+            : results(""), wal("journal", durability, commitDelay) {
+        for (uint32_t i = 0; i < shardCount; i++) {
+            char path[32];
+            std::snprintf(path, sizeof(path), "users.%02u.idx", i);
+            shards[i].store = std::make_unique<UserStore>(path, i + 1, shardCount);
+        }
+        recover();
+        if (userCount() == 0 && !importSingleStore()) {
+            importLegacyUsers();
+        }
+        checkpoint();
+        checkpointer = std::thread(&UserManager::runCheckpointer, this);
     }
 
-    bool registerUser(const std::string& username, const std::string& password) {
-        if (users.find(username) != users.end()) {
-            std::cout << "Пользователь с таким именем уже существует.\n";
+    ~UserManager() {
+        {
+            std::lock_guard<std::mutex> lock(checkpointerMutex);
+            stopping = true;
+        }
+        checkpointerWake.notify_one();
+        checkpointer.join();
+        if (checkpoint()) {
+            std::lock_guard<std::mutex> lock(resultsMutex);
+            results.markClean();
+        }
+    }
+
+    UserManager(const UserManager&) = delete;
+    UserManager& operator=(const UserManager&) = delete;
+
+    // Контрольная точка: под разделяемыми блокировками шардов журнал переключается
+    // на новый файл (граница между записями до и после точки), затем хранилища по
+    // одному сбрасываются на диск, и старые файлы журнала удаляются. Входы в систему
+    // не ждут никогда; регистрация ждет только сброса своего шарда.
+    bool checkpoint() {
+        std::lock_guard<std::mutex> serial(checkpointMutex);
+        uint64_t segment;
+        {
+            std::shared_lock<std::shared_mutex> locks[shardCount];
+            for (uint32_t i = 0; i < shardCount; i++) {
+                locks[i] = std::shared_lock<std::shared_mutex>(shards[i].mutex);
+            }
+            std::lock_guard<std::mutex> resultsLock(resultsMutex);
+            segment = wal.rotate(results.records());
+        }
+        if (segment == 0) {
             return false;
         }
-        users[username] = {username, password};
-        saveUser({username, password});
-        std::cout << "Регистрация успешна!\n";
-        return true;
+
+        // Результаты сбрасываются без resultsMutex, чтобы запись новых результатов
+        // не ждала fdatasync; дескрипторы закрываются только в деструкторе хранилища.
+        std::vector<int> fds;
+        bool ok;
+        {
+            std::lock_guard<std::mutex> resultsLock(resultsMutex);
+            ok = results.syncTargets(fds);
+        }
+        for (int fd : fds) {
+            ok = fdatasync(fd) == 0 && ok;
+        }
+        for (Shard& shard : shards) {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            ok = shard.store->sync() && ok;
+        }
+        if (ok) {
+            wal.dropBefore(segment);
+        }
+        return ok;
+    }
+
+    // Фиксирует в журнале все записи, сделанные с commit = false.
+    bool commitPending() {
+        bool ok = wal.commitAll();
+        maybeCheckpoint();
+        return ok;
+    }
+
+    // Регистрация в два шага для тех, кто не может ждать fdatasync (цикл сервера):
+    // пользователь вставляется и записывается в журнал, затем после waitDurable
+    // finishRegistration подтверждает его или убирает.
+    RegisterStatus beginRegistration(const std::string& username, const std::string& password, uint64_t& lsn) {
+        if (username.size() > UserStore::maxNameLength || password.size() > UserStore::maxPasswordLength) {
+            return RegisterStatus::TooLong;
+        }
+        Shard& shard = shardFor(username);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        if (shard.store->find(username) != nullptr) {
+            return RegisterStatus::Exists;
+        }
+        uint32_t id;
+        if (!shard.store->insert(username, password, &id)) {
+            return RegisterStatus::Failed;
+        }
+        lsn = wal.logRegistration(id, username, password);
+        return RegisterStatus::Ok;
+    }
+
+    // Незафиксированная регистрация убирается из шарда: иначе пользователь, которому
+    // ответили об ошибке, мог бы войти, а повторная регистрация ответила бы Exists.
+    RegisterStatus finishRegistration(const std::string& username, bool durable) {
+        if (durable) {
+            return RegisterStatus::Ok;
+        }
+        Shard& shard = shardFor(username);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        shard.store->remove(username);
+        return RegisterStatus::Failed;
+    }
+
+    RegisterStatus addUser(const std::string& username, const std::string& password) {
+        uint64_t lsn;
+        RegisterStatus status = beginRegistration(username, password, lsn);
+        if (status != RegisterStatus::Ok) {
+            return status;
+        }
+        return finishRegistration(username, waitDurable(lsn));
+    }
+
+    bool checkCredentials(const std::string& username, const std::string& password) {
+        Shard& shard = shardFor(username);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        const UserSlot* user = shard.store->find(username);
+        return user != nullptr && UserStore::passwordMatches(*user, password);
+    }
+
+    bool registerUser(const std::string& username, const std::string& password) {
+        switch (addUser(username, password)) {
+            case RegisterStatus::Ok:
+                std::cout << "Регистрация успешна!\n";
+                return true;
+            case RegisterStatus::Exists:
+                std::cout << "Пользователь с таким именем уже существует.\n";
+                return false;
+            case RegisterStatus::TooLong:
+                std::cout << "Имя пользователя слишком длинное.\n";
+                return false;
+            default:
+                std::cout << "Не удалось сохранить пользователя.\n";
+                return false;
+        }
     }
 
     bool loginUser(const std::string& username, const std::string& password) {
-        if (users.find(username) != users.end() && users[username].password == password) {
+        if (checkCredentials(username, password)) {
             std::cout << "Добро пожаловать, " << username << "!\n";
             return true;
         }
@@ -60,67 +360,160 @@ public:
         return false;
     }
 
+    // Ждет, пока запись журнала lsn и все предыдущие окажутся на диске.
+    bool waitDurable(uint64_t lsn) {
+        bool durable = wal.commit(lsn);
+        maybeCheckpoint();
+        return durable;
+    }
+
+    // Сохраняет результат и записывает его в журнал без фиксации; lsn - для waitDurable.
+    bool logResult(const std::string& username, int situationalScore, int personalScore, int64_t timestamp,
+                   uint64_t& lsn) {
+        uint32_t id;
+        if (!lookupId(username, id)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(resultsMutex);
+        importLegacyResults(username, id);
+        if (!results.append(id, situationalScore, personalScore, timestamp)) {
+            return false;
+        }
+        lsn = wal.logResult(id, situationalScore, personalScore, timestamp);
+        return true;
+    }
+
+    bool appendResult(const std::string& username, int situationalScore, int personalScore, int64_t timestamp,
+                      bool commit = true) {
+        uint64_t lsn;
+        if (!logResult(username, situationalScore, personalScore, timestamp, lsn)) {
+            return false;
+        }
+        return !commit || waitDurable(lsn);
+    }
+
     void saveTestResult(const std::string& username, int situationalScore, int personalScore) {
-        std::ofstream file(username + "_results.txt", std::ios::app);
-        file << situationalScore << " " << personalScore << "\n";
-        file.close();
+        uint32_t id;
+        if (lookupId(username, id) && !appendResult(username, situationalScore, personalScore, std::time(nullptr))) {
+            std::cout << "Не удалось сохранить результат теста.\n";
+        }
     }
 
     void viewTestHistory(const std::string& username) {
-        std::ifstream file(username + "_results.txt");
-        if (!file.is_open()) {
+        std::vector<ResultRecord> history = testHistory(username);
+        if (history.empty()) {
             std::cout << "История тестов не найдена.\n";
             return;
         }
 
-        std::string line;
         std::cout << "История тестов для пользователя " << username << ":\n";
-        while (std::getline(file, line)) {
-            std::cout << line << std::endl;
+        for (const ResultRecord& record : history) {
+            if (record.timestamp != 0) {
+                char date[32];
+                std::time_t time = static_cast<std::time_t>(record.timestamp);
+                std::strftime(date, sizeof(date), "%d.%m.%Y %H:%M", std::localtime(&time));
+                std::cout << date << "  ";
+            }
+            std::cout << record.situational << " " << record.personal << std::endl;
         }
-        file.close();
     }
 
-    void compareResults(const std::string& username, int situationalScore, int personalScore) {
-        std::ifstream file(username + "_results.txt");
-        if (!file.is_open()) {
-            std::cout << "История тестов не найдена.\n";
-            return;
+    std::vector<ResultRecord> testHistory(const std::string& username) {
+        uint32_t id;
+        if (!lookupId(username, id)) {
+            return {};
         }
+        std::lock_guard<std::mutex> lock(resultsMutex);
+        importLegacyResults(username, id);
+        return results.history(id);
+    }
 
-        std::string line;
-        int previousSituationalScore = 0;
-        int previousPersonalScore = 0;
-        int count = 0;
+    bool resultSummary(const std::string& username, UserResultsEntry& summary) {
+        uint32_t id;
+        if (!lookupId(username, id)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(resultsMutex);
+        const UserResultsEntry* entry = results.summary(id);
+        if (entry == nullptr) {
+            return false;
+        }
+        summary = *entry;
+        return true;
+    }
 
-        while (std::getline(file, line)) {
-            std::istringstream iss(line);
-            int situational, personal;
-            iss >> situational >> personal;
+    // Место результата среди всех сохраненных и среди пройденных в том же месяце.
+    bool populationRank(int situationalScore, int personalScore, int64_t timestamp, PopulationRank& rank) {
+        std::lock_guard<std::mutex> lock(resultsMutex);
+        const PercentileIndex& index = results.percentileIndex();
+        const CohortHistograms* population = index.population();
+        if (population == nullptr || population->situational.total == 0) {
+            return false;
+        }
+        rank.situational = population->situational.percentile(situationalScore);
+        rank.personal = population->personal.percentile(personalScore);
+        rank.population = population->situational.total;
+        const CohortHistograms* cohort = index.cohort(PercentileIndex::cohortOf(timestamp));
+        rank.cohortSize = cohort != nullptr ? cohort->situational.total : 0;
+        rank.cohortSituational = rank.cohortSize ? cohort->situational.percentile(situationalScore) : 0.0;
+        rank.cohortPersonal = rank.cohortSize ? cohort->personal.percentile(personalScore) : 0.0;
+        return true;
+    }
 
-            previousSituationalScore += situational;
-            previousPersonalScore += personal;
-            count++;
+    // Число результатов (и, если нужно, пользователей), подходящих под фильтр
+    // по уровням тревожности и месяцам прохождения.
+    CohortCount countResults(const CohortFilter& filter) {
+        std::lock_guard<std::mutex> lock(resultsMutex);
+        return results.countCohort(filter);
+    }
+
+    void comparePopulation(int situationalScore, int personalScore) {
+        PopulationRank rank {};
+        if (!populationRank(situationalScore, personalScore, std::time(nullptr), rank)) {
+            return;
         }
+        std::printf("\nСреди %llu результатов ваша ситуативная тревожность выше, чем у %.1f%%, "
+                    "личностная - чем у %.1f%%\n",
+                    static_cast<unsigned long long>(rank.population), rank.situational, rank.personal);
+        if (rank.cohortSize > 0) {
+            std::printf("Среди %llu результатов этого месяца: %.1f%% и %.1f%%\n",
+                        static_cast<unsigned long long>(rank.cohortSize), rank.cohortSituational,
+                        rank.cohortPersonal);
+        }
+    }
 
-        if (count > 0) {
-            previousSituationalScore /= count;
-            previousPersonalScore /= count;
+    void compareResults(const std::string& username, int situationalScore, int personalScore) {
+        UserResultsEntry summary;
+        if (!resultSummary(username, summary)) {
+            std::cout << "История тестов не найдена.\n";
+            return;
+        }
 
-            std::cout << "\nСравнение с предыдущими результатами:\n";
-            std::cout << "Ситуативная тревожность: " << situationalScore << " (предыдущее: " << previousSituationalScore << ")\n";
-            std::cout << "Личностная тревожность: " << personalScore << " (предыдущее: " << previousPersonalScore << ")\n";
+        uint64_t count = summary.count;
+        int previousSituationalScore = static_cast<int>(summary.situational.sum / static_cast<int64_t>(count));
+        int previousPersonalScore = static_cast<int>(summary.personal.sum / static_cast<int64_t>(count));
 
-            if (situationalScore > previousSituationalScore) {
-                std::cout << "Ваши результаты ухудшились. Рекомендуем обратиться к специалисту.\n";
-            } else if (situationalScore < previousSituationalScore) {
-                std::cout << "Молодец! Ваши результаты улучшились.\n";
-            } else {
-                std::cout << "Результаты остались без изменений. Пожелаем вам улучшений.\n";
-            }
+        std::cout << "\nСравнение с предыдущими результатами:\n";
+        std::cout << "Ситуативная тревожность: " << situationalScore << " (предыдущее: " << previousSituationalScore << ")\n";
+        std::cout << "Личностная тревожность: " << personalScore << " (предыдущее: " << previousPersonalScore << ")\n";
+
+        if (count > 1) {
+            std::printf("Тестов пройдено: %llu\n", static_cast<unsigned long long>(count));
+            std::printf("Ситуативная: мин. %d, макс. %d, отклонение %.1f, тренд %+.1f за тест\n",
+                        summary.situational.min, summary.situational.max,
+                        std::sqrt(summary.situational.variance(count)), summary.situational.trend(count));
+            std::printf("Личностная: мин. %d, макс. %d, отклонение %.1f, тренд %+.1f за тест\n",
+                        summary.personal.min, summary.personal.max,
+                        std::sqrt(summary.personal.variance(count)), summary.personal.trend(count));
         }
 
-        file.close();
+        if (situationalScore > previousSituationalScore) {
+            std::cout << "Ваши результаты ухудшились. Рекомендуем обратиться к специалисту.\n";
+        } else if (situationalScore < previousSituationalScore) {
+            std::cout << "Молодец! Ваши результаты улучшились.\n";
+        } else {
+            std::cout << "Результаты остались без изменений. Пожелаем вам улучшений.\n";
+        }
     }
 };
 
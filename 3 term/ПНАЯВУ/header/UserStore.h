@@ -0,0 +1,483 @@
+#ifndef LAB_2_USERSTORE_H
+#define LAB_2_USERSTORE_H
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Ячейка занимает ровно одну строку кэша. Имена до inlineNameLength байт хранятся
+// прямо в ячейке; для более длинных в name лежит смещение в файле имен (path + ".names").
+struct UserSlot {
+    static constexpr size_t inlineNameLength = 32;
+
+    uint64_t hash;
+    uint32_t id;
+    uint8_t nameLength;
+    uint8_t passwordLength;
+    uint16_t reserved;
+    char password[16];
+    char name[inlineNameLength];
+};
+
+struct UserStoreHeader {
+    char magic[8];
+    uint64_t capacity;
+    uint64_t count;
+    uint32_t nextId;
+    uint32_t idStride;
+    uint64_t namesUsed;
+    uint32_t reserved[6];
+};
+
+class UserStore {
+private:
+    // Формат первой версии: 128-байтная ячейка с именем целиком внутри.
+    struct LegacyUserSlot {
+        uint64_t hash;
+        uint32_t id;
+        uint8_t nameLength;
+        uint8_t passwordLength;
+        uint16_t reserved;
+        char password[16];
+        char name[96];
+    };
+
+    static constexpr uint64_t initialCapacity = 1024;
+    static constexpr size_t initialNamesSize = 64 * 1024;
+
+    std::string path;
+    std::string namesPath;
+    uint32_t firstId = 1;
+    uint32_t idStride = 1;
+    int fd = -1;
+    size_t mappedSize = 0;
+    UserStoreHeader* header = nullptr;
+    UserSlot* slots = nullptr;
+    int namesFd = -1;
+    size_t namesSize = 0;
+    char* names = nullptr;
+
+    static size_t fileSize(uint64_t capacity) {
+        return sizeof(UserStoreHeader) + capacity * sizeof(UserSlot);
+    }
+
+    // Таблица с линейным пробированием по маске: емкость - ненулевая степень двойки.
+    static bool validCapacity(uint64_t capacity) {
+        return capacity != 0 && (capacity & (capacity - 1)) == 0 && capacity <= (1ULL << 40);
+    }
+
+    bool map(const std::string& filePath, uint64_t capacity, bool create) {
+        int newFd = ::open(filePath.c_str(), O_RDWR | O_CREAT, 0600);
+        if (newFd < 0) {
+            return false;
+        }
+        struct stat st {};
+        if (fstat(newFd, &st) < 0) {
+            ::close(newFd);
+            return false;
+        }
+        bool fresh = create || st.st_size == 0;
+        if (fresh) {
+            if (ftruncate(newFd, fileSize(capacity)) < 0) {
+                ::close(newFd);
+                return false;
+            }
+        } else {
+            // Заголовок проверяется до отображения: емкость из чужого или обрезанного
+            // файла дала бы отображение за концом файла и SIGBUS при обращении.
+            UserStoreHeader existing {};
+            if (pread(newFd, &existing, sizeof(existing), 0) != sizeof(existing)) {
+                ::close(newFd);
+                return false;
+            }
+            capacity = existing.capacity;
+            bool legacy = std::memcmp(existing.magic, "USRSTOR1", 8) == 0;
+            size_t slotSize = legacy ? sizeof(LegacyUserSlot) : sizeof(UserSlot);
+            if ((!legacy && std::memcmp(existing.magic, "USRSTOR2", 8) != 0) || !validCapacity(capacity) ||
+                sizeof(UserStoreHeader) + capacity * slotSize > static_cast<uint64_t>(st.st_size)) {
+                std::cout << "Файл " << filePath << " поврежден или имеет неизвестный формат\n";
+                ::close(newFd);
+                return false;
+            }
+            if (legacy) {
+                ::close(newFd);
+                return convertLegacy(filePath, existing);
+            }
+        }
+        void* memory = mmap(nullptr, fileSize(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, newFd, 0);
+        if (memory == MAP_FAILED) {
+            ::close(newFd);
+            return false;
+        }
+        unmap();
+        fd = newFd;
+        mappedSize = fileSize(capacity);
+        header = static_cast<UserStoreHeader*>(memory);
+        slots = reinterpret_cast<UserSlot*>(header + 1);
+        if (fresh) {
+            std::memcpy(header->magic, "USRSTOR2", 8);
+            header->capacity = capacity;
+            header->count = 0;
+            header->nextId = firstId;
+            header->idStride = idStride;
+            header->namesUsed = 0;
+        }
+        if (header->idStride == 0) {
+            header->idStride = 1;
+        }
+        if (header->namesUsed != 0 && !mapNames(header->namesUsed)) {
+            unmap();
+            return false;
+        }
+        return true;
+    }
+
+    void unmap() {
+        if (header) {
+            munmap(header, mappedSize);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        if (names) {
+            munmap(names, namesSize);
+        }
+        if (namesFd >= 0) {
+            ::close(namesFd);
+        }
+        header = nullptr;
+        slots = nullptr;
+        fd = -1;
+        mappedSize = 0;
+        names = nullptr;
+        namesFd = -1;
+        namesSize = 0;
+    }
+
+    bool mapNames(size_t required) {
+        if (namesFd < 0) {
+            namesFd = ::open(namesPath.c_str(), O_RDWR | O_CREAT, 0600);
+            if (namesFd < 0) {
+                return false;
+            }
+        }
+        struct stat st {};
+        if (fstat(namesFd, &st) < 0) {
+            return false;
+        }
+        // Файл имен должен содержать все, что учтено в заголовке.
+        if (!names && static_cast<uint64_t>(st.st_size) < header->namesUsed) {
+            std::cout << "Файл имен " << namesPath << " обрезан\n";
+            return false;
+        }
+        size_t size = static_cast<size_t>(st.st_size) > initialNamesSize ? st.st_size : initialNamesSize;
+        while (size < required) {
+            size *= 2;
+        }
+        if (names && size == namesSize) {
+            return true;
+        }
+        if (static_cast<size_t>(st.st_size) < size && ftruncate(namesFd, size) < 0) {
+            return false;
+        }
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, namesFd, 0);
+        if (memory == MAP_FAILED) {
+            return false;
+        }
+        if (names) {
+            munmap(names, namesSize);
+        }
+        names = static_cast<char*>(memory);
+        namesSize = size;
+        return true;
+    }
+
+    const char* nameData(const UserSlot& slot) const {
+        if (slot.nameLength <= UserSlot::inlineNameLength) {
+            return slot.name;
+        }
+        static const char missing[maxNameLength] = {};
+        uint64_t offset;
+        std::memcpy(&offset, slot.name, sizeof(offset));
+        if (!names || offset > namesSize || namesSize - offset < slot.nameLength) {
+            return missing;
+        }
+        return names + offset;
+    }
+
+    bool storeName(UserSlot& slot, const std::string& name) {
+        slot.nameLength = static_cast<uint8_t>(name.size());
+        if (name.size() <= UserSlot::inlineNameLength) {
+            std::memcpy(slot.name, name.data(), name.size());
+            return true;
+        }
+        uint64_t offset = header->namesUsed;
+        if (!mapNames(offset + name.size())) {
+            return false;
+        }
+        std::memcpy(names + offset, name.data(), name.size());
+        std::memcpy(slot.name, &offset, sizeof(offset));
+        header->namesUsed = offset + name.size();
+        return true;
+    }
+
+    UserSlot* probe(UserSlot* table, uint64_t capacity, uint64_t hash, const std::string& name) const {
+        uint64_t mask = capacity - 1;
+        for (uint64_t i = hash & mask;; i = (i + 1) & mask) {
+            UserSlot& slot = table[i];
+            if (slot.hash == 0) {
+                return &slot;
+            }
+            if (slot.hash == hash && slot.nameLength == name.size() &&
+                std::memcmp(nameData(slot), name.data(), name.size()) == 0) {
+                return &slot;
+            }
+        }
+    }
+
+    // Имена при переносе заведомо различны, поэтому достаточно первой свободной ячейки.
+    static UserSlot* emptySlot(UserSlot* table, uint64_t capacity, uint64_t hash) {
+        uint64_t mask = capacity - 1;
+        uint64_t i = hash & mask;
+        while (table[i].hash != 0) {
+            i = (i + 1) & mask;
+        }
+        return &table[i];
+    }
+
+    bool grow() {
+        uint64_t capacity = header->capacity * 2;
+        std::string tmpPath = path + ".tmp";
+        ::unlink(tmpPath.c_str());
+
+        UserStore bigger;
+        bigger.path = tmpPath;
+        bigger.namesPath = namesPath;
+        if (!bigger.map(tmpPath, capacity, true)) {
+            return false;
+        }
+        for (uint64_t i = 0; i < header->capacity; i++) {
+            if (slots[i].hash != 0) {
+                *emptySlot(bigger.slots, capacity, slots[i].hash) = slots[i];
+            }
+        }
+        bigger.header->count = header->count;
+        bigger.header->nextId = header->nextId;
+        bigger.header->idStride = header->idStride;
+        bigger.header->namesUsed = header->namesUsed;
+        msync(bigger.header, bigger.mappedSize, MS_SYNC);
+        bigger.unmap();
+
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            return false;
+        }
+        return map(path, capacity, false);
+    }
+
+    // Переписывает файл первой версии в компактный формат той же емкости.
+    bool convertLegacy(const std::string& filePath, const UserStoreHeader& legacy) {
+        int legacyFd = ::open(filePath.c_str(), O_RDONLY);
+        if (legacyFd < 0) {
+            return false;
+        }
+        size_t legacySize = sizeof(UserStoreHeader) + legacy.capacity * sizeof(LegacyUserSlot);
+        void* memory = mmap(nullptr, legacySize, PROT_READ, MAP_SHARED, legacyFd, 0);
+        ::close(legacyFd);
+        if (memory == MAP_FAILED) {
+            return false;
+        }
+        const auto* legacySlots = reinterpret_cast<const LegacyUserSlot*>(static_cast<const char*>(memory) +
+                                                                          sizeof(UserStoreHeader));
+
+        std::string tmpPath = filePath + ".tmp";
+        ::unlink(tmpPath.c_str());
+        UserStore compact;
+        compact.path = tmpPath;
+        compact.namesPath = namesPath;
+        bool ok = compact.map(tmpPath, legacy.capacity, true);
+        for (uint64_t i = 0; ok && i < legacy.capacity; i++) {
+            const LegacyUserSlot& old = legacySlots[i];
+            if (old.hash == 0) {
+                continue;
+            }
+            UserSlot* slot = emptySlot(compact.slots, legacy.capacity, old.hash);
+            slot->id = old.id;
+            slot->passwordLength = old.passwordLength;
+            std::memcpy(slot->password, old.password, sizeof(slot->password));
+            ok = compact.storeName(*slot, std::string(old.name, old.nameLength));
+            slot->hash = old.hash;
+        }
+        munmap(memory, legacySize);
+        if (!ok) {
+            return false;
+        }
+        compact.header->count = legacy.count;
+        compact.header->nextId = legacy.nextId;
+        compact.header->idStride = legacy.idStride ? legacy.idStride : 1;
+        msync(compact.header, compact.mappedSize, MS_SYNC);
+        compact.unmap();
+
+        if (std::rename(tmpPath.c_str(), filePath.c_str()) != 0) {
+            return false;
+        }
+        return map(filePath, legacy.capacity, false);
+    }
+
+    UserStore() = default;
+
+public:
+    static constexpr size_t maxNameLength = UINT8_MAX;
+    static constexpr size_t maxPasswordLength = sizeof(UserSlot::password);
+
+    static uint64_t hashName(const std::string& name) {
+        uint64_t h = 1469598103934665603ULL;
+        for (unsigned char c : name) {
+            h = (h ^ c) * 1099511628211ULL;
+        }
+        return h ? h : 1;
+    }
+
+    // Несколько хранилищ могут делить одно пространство идентификаторов:
+    // хранилище выдает firstId, firstId + idStride, firstId + 2 * idStride...
+    explicit UserStore(const std::string& path, uint32_t firstId = 1, uint32_t idStride = 1)
+            : path(path), namesPath(path + ".names"), firstId(firstId), idStride(idStride) {
+        if (!map(path, initialCapacity, false)) {
+            std::cout << "Не удалось открыть хранилище пользователей " << path << "\n";
+        }
+    }
+
+    ~UserStore() {
+        unmap();
+    }
+
+    UserStore(const UserStore&) = delete;
+    UserStore& operator=(const UserStore&) = delete;
+
+    bool isOpen() const {
+        return header != nullptr;
+    }
+
+    uint64_t size() const {
+        return header ? header->count : 0;
+    }
+
+    // Объем отображения: таблица плюс файл длинных имен.
+    uint64_t footprint() const {
+        return mappedSize + namesSize;
+    }
+
+    bool sync() {
+        bool ok = header != nullptr && msync(header, mappedSize, MS_SYNC) == 0;
+        if (names && msync(names, namesSize, MS_SYNC) != 0) {
+            ok = false;
+        }
+        return ok;
+    }
+
+    std::string name(const UserSlot& slot) const {
+        return std::string(nameData(slot), slot.nameLength);
+    }
+
+    const UserSlot* find(const std::string& name) const {
+        if (!header || name.size() > maxNameLength) {
+            return nullptr;
+        }
+        const UserSlot* slot = probe(slots, header->capacity, hashName(name), name);
+        return slot->hash != 0 ? slot : nullptr;
+    }
+
+    bool insert(const std::string& name, const std::string& password, uint32_t* id = nullptr) {
+        return insertWithId(name, password, 0, id);
+    }
+
+    // Вставка с заранее известным идентификатором (перенос из другого хранилища).
+    bool restore(const std::string& name, const std::string& password, uint32_t id) {
+        return insertWithId(name, password, id, nullptr);
+    }
+
+    // Удаление со сдвигом назад: ячейки той же цепочки пробирования переезжают в
+    // освободившуюся, поэтому поиск по-прежнему останавливается на первой пустой.
+    // Длинное имя остается в файле имен неиспользованным.
+    bool remove(const std::string& name) {
+        if (!header || name.size() > maxNameLength) {
+            return false;
+        }
+        UserSlot* slot = probe(slots, header->capacity, hashName(name), name);
+        if (slot->hash == 0) {
+            return false;
+        }
+        uint64_t mask = header->capacity - 1;
+        uint64_t hole = static_cast<uint64_t>(slot - slots);
+        for (uint64_t i = (hole + 1) & mask; slots[i].hash != 0; i = (i + 1) & mask) {
+            uint64_t home = slots[i].hash & mask;
+            if (((i - home) & mask) >= ((i - hole) & mask)) {
+                slots[hole] = slots[i];
+                hole = i;
+            }
+        }
+        std::memset(&slots[hole], 0, sizeof(UserSlot));
+        header->count--;
+        return true;
+    }
+
+    // Следующие выданные идентификаторы будут больше usedId.
+    void reserveIds(uint32_t usedId) {
+        if (!header || header->nextId > usedId) {
+            return;
+        }
+        uint32_t stride = header->idStride;
+        header->nextId += ((usedId - header->nextId) / stride + 1) * stride;
+    }
+
+    template <typename Function>
+    void forEach(Function function) const {
+        for (uint64_t i = 0; header && i < header->capacity; i++) {
+            if (slots[i].hash != 0) {
+                function(slots[i]);
+            }
+        }
+    }
+
+    static bool passwordMatches(const UserSlot& slot, const std::string& password) {
+        return slot.passwordLength == password.size() &&
+               std::memcmp(slot.password, password.data(), password.size()) == 0;
+    }
+
+private:
+    bool insertWithId(const std::string& name, const std::string& password, uint32_t fixedId, uint32_t* id) {
+        if (!header || name.empty() || name.size() > maxNameLength || password.size() > maxPasswordLength) {
+            return false;
+        }
+        if ((header->count + 1) * 10 > header->capacity * 7 && !grow()) {
+            return false;
+        }
+        uint64_t hash = hashName(name);
+        UserSlot* slot = probe(slots, header->capacity, hash, name);
+        if (slot->hash != 0 || !storeName(*slot, name)) {
+            return false;
+        }
+        if (fixedId != 0) {
+            slot->id = fixedId;
+            reserveIds(fixedId);
+        } else {
+            slot->id = header->nextId;
+            header->nextId += header->idStride;
+        }
+        slot->passwordLength = static_cast<uint8_t>(password.size());
+        std::memcpy(slot->password, password.data(), password.size());
+        slot->hash = hash;
+        header->count++;
+        if (id) {
+            *id = slot->id;
+        }
+        return true;
+    }
+};
+
+#endif //LAB_2_USERSTORE_H
@@ -0,0 +1,380 @@
+#ifndef LAB_2_WRITEAHEADLOG_H
+#define LAB_2_WRITEAHEADLOG_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+enum class Durability {
+    None,   // запись в журнал без fsync: переживает падение процесса, но не питания
+    Group   // fsync до подтверждения; один fsync покрывает все записи, накопленные к этому моменту
+};
+
+// Журнал упреждающей записи для регистраций и результатов. Изменения сначала попадают
+// в журнал, затем в отображаемые хранилища. Журнал состоит из файлов <prefix>.NNNNNN.wal:
+// контрольная точка открывает новый файл, а старые удаляет после сброса хранилищ.
+// Групповая фиксация: первый ожидающий поток становится ведущим, ждет commitDelay,
+// чтобы собрать записи соседей, и делает одну запись и один fdatasync на всех.
+// После ошибки записи или fdatasync журнал обрезается до последней подтвержденной
+// записи и переходит в состояние отказа: ни одна следующая запись не подтверждается
+// (повторный fdatasync после ошибки может вернуть успех, не записав данных).
+class WriteAheadLog {
+public:
+    enum RecordType : uint8_t {
+        Registration = 1,
+        Result = 2
+    };
+
+private:
+    struct FileHeader {
+        char magic[8];
+        uint64_t checkpointResults;
+    };
+
+    struct RecordHeader {
+        uint32_t size;
+        uint32_t checksum;
+    };
+
+    std::string prefix;
+    Durability durability;
+    std::chrono::microseconds commitDelay;
+    int fd = -1;
+    uint64_t sequence = 0;
+
+    std::mutex mutex;
+    std::condition_variable flushed;
+    std::string pending;
+    uint64_t appended = 0;
+    uint64_t durable = 0;
+    uint64_t fileSize = 0;
+    bool flushing = false;
+    bool failed = false;
+
+    static uint32_t checksum(const char* data, size_t size) {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < size; i++) {
+            h = (h ^ static_cast<unsigned char>(data[i])) * 16777619u;
+        }
+        return h;
+    }
+
+    uint64_t append(const std::string& payload) {
+        RecordHeader record {static_cast<uint32_t>(payload.size()), checksum(payload.data(), payload.size())};
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.append(reinterpret_cast<const char*>(&record), sizeof(record));
+        pending += payload;
+        appended += sizeof(record) + payload.size();
+        return appended;
+    }
+
+    static void put(std::string& out, const void* data, size_t size) {
+        out.append(static_cast<const char*>(data), size);
+    }
+
+    template <typename T>
+    static bool take(const char*& p, const char* end, T& value) {
+        if (static_cast<size_t>(end - p) < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+
+    std::string segmentPath(uint64_t number) const {
+        char suffix[32];
+        std::snprintf(suffix, sizeof(suffix), ".%06llu.wal", static_cast<unsigned long long>(number));
+        return prefix + suffix;
+    }
+
+    // Номера существующих файлов журнала по возрастанию.
+    std::vector<uint64_t> segments() const {
+        std::vector<uint64_t> numbers;
+        size_t slash = prefix.rfind('/');
+        std::string directory = slash == std::string::npos ? "." : prefix.substr(0, slash);
+        std::string base = (slash == std::string::npos ? prefix : prefix.substr(slash + 1)) + ".";
+        DIR* dir = opendir(directory.c_str());
+        if (dir == nullptr) {
+            return numbers;
+        }
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.size() == base.size() + 10 && name.compare(0, base.size(), base) == 0 &&
+                name.compare(name.size() - 4, 4, ".wal") == 0) {
+                numbers.push_back(std::strtoull(name.c_str() + base.size(), nullptr, 10));
+            }
+        }
+        closedir(dir);
+        std::sort(numbers.begin(), numbers.end());
+        return numbers;
+    }
+
+    int createSegment(uint64_t number, uint64_t checkpointResults) {
+        int newFd = ::open(segmentPath(number).c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0600);
+        if (newFd < 0) {
+            return -1;
+        }
+        FileHeader header {};
+        std::memcpy(header.magic, "ANXWAL01", 8);
+        header.checkpointResults = checkpointResults;
+        if (::write(newFd, &header, sizeof(header)) != sizeof(header) || fdatasync(newFd) != 0) {
+            ::close(newFd);
+            ::unlink(segmentPath(number).c_str());
+            return -1;
+        }
+        return newFd;
+    }
+
+    bool writeBatch(const std::string& batch) {
+        bool ok = batch.empty() || ::write(fd, batch.data(), batch.size()) == static_cast<ssize_t>(batch.size());
+        if (ok && durability == Durability::Group) {
+            ok = fdatasync(fd) == 0;
+        }
+        return ok;
+    }
+
+    // Вызывается под mutex: убирает из файла недописанный пакет, чтобы разорванная
+    // запись не скрыла при восстановлении ничего после себя, и отказывает всем ожидающим.
+    void fail() {
+        failed = true;
+        if (fd >= 0 && ftruncate(fd, static_cast<off_t>(fileSize)) != 0) {
+            std::cout << "Не удалось обрезать журнал " << segmentPath(sequence) << "\n";
+        }
+        pending.clear();
+        std::cout << "Ошибка записи журнала, изменения больше не подтверждаются\n";
+    }
+
+    template <typename OnRegistration, typename OnResult>
+    static uint64_t replayRecords(const char* p, const char* end, OnRegistration& onRegistration,
+                                  OnResult& onResult) {
+        uint64_t replayed = 0;
+        RecordHeader record {};
+        while (take(p, end, record) && static_cast<size_t>(end - p) >= record.size &&
+               checksum(p, record.size) == record.checksum) {
+            const char* field = p;
+            const char* recordEnd = p + record.size;
+            p = recordEnd;
+            uint8_t type = 0;
+            take(field, recordEnd, type);
+            if (type == Registration) {
+                uint32_t id;
+                uint8_t nameLength, passwordLength;
+                if (take(field, recordEnd, id) && take(field, recordEnd, nameLength) &&
+                    take(field, recordEnd, passwordLength) &&
+                    static_cast<size_t>(recordEnd - field) == static_cast<size_t>(nameLength) + passwordLength) {
+                    onRegistration(id, std::string(field, nameLength),
+                                   std::string(field + nameLength, passwordLength));
+                }
+            } else if (type == Result) {
+                uint32_t userId;
+                int16_t situational, personal;
+                int64_t timestamp;
+                if (take(field, recordEnd, userId) && take(field, recordEnd, situational) &&
+                    take(field, recordEnd, personal) && take(field, recordEnd, timestamp)) {
+                    onResult(userId, situational, personal, timestamp);
+                }
+            }
+            replayed++;
+        }
+        return replayed;
+    }
+
+public:
+    WriteAheadLog(const std::string& prefix, Durability durability, std::chrono::microseconds commitDelay)
+            : prefix(prefix), durability(durability), commitDelay(commitDelay) {
+        // Журнал одним файлом (до разбиения на сегменты) становится нулевым сегментом.
+        std::string single = prefix + ".wal";
+        if (access(single.c_str(), F_OK) == 0 && segments().empty()) {
+            std::rename(single.c_str(), segmentPath(0).c_str());
+        }
+        std::vector<uint64_t> existing = segments();
+        sequence = existing.empty() ? 0 : existing.back();
+        fd = ::open(segmentPath(sequence).c_str(), O_RDWR | O_CREAT | O_APPEND, 0600);
+        struct stat st {};
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            std::cout << "Не удалось открыть журнал " << segmentPath(sequence) << "\n";
+            return;
+        }
+        fileSize = static_cast<uint64_t>(st.st_size);
+    }
+
+    ~WriteAheadLog() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Размер текущего файла журнала вместе с еще не записанными данными.
+    uint64_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return fileSize + pending.size();
+    }
+
+    uint64_t logRegistration(uint32_t id, const std::string& name, const std::string& password) {
+        std::string payload;
+        uint8_t type = Registration;
+        uint8_t nameLength = static_cast<uint8_t>(name.size());
+        uint8_t passwordLength = static_cast<uint8_t>(password.size());
+        put(payload, &type, sizeof(type));
+        put(payload, &id, sizeof(id));
+        put(payload, &nameLength, sizeof(nameLength));
+        put(payload, &passwordLength, sizeof(passwordLength));
+        payload += name;
+        payload += password;
+        return append(payload);
+    }
+
+    uint64_t logResult(uint32_t userId, int situational, int personal, int64_t timestamp) {
+        std::string payload;
+        uint8_t type = Result;
+        int16_t situationalScore = static_cast<int16_t>(situational);
+        int16_t personalScore = static_cast<int16_t>(personal);
+        put(payload, &type, sizeof(type));
+        put(payload, &userId, sizeof(userId));
+        put(payload, &situationalScore, sizeof(situationalScore));
+        put(payload, &personalScore, sizeof(personalScore));
+        put(payload, &timestamp, sizeof(timestamp));
+        return append(payload);
+    }
+
+    // Дожидается, пока запись с номером lsn окажется в файле (и на диске в режиме Group).
+    bool commit(uint64_t lsn) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (durable < lsn) {
+            if (failed) {
+                return false;
+            }
+            if (flushing) {
+                flushed.wait(lock);
+                continue;
+            }
+            flushing = true;
+            if (durability == Durability::Group && commitDelay.count() > 0) {
+                lock.unlock();
+                std::this_thread::sleep_for(commitDelay);
+                lock.lock();
+            }
+            std::string batch;
+            batch.swap(pending);
+            uint64_t target = appended;
+            lock.unlock();
+
+            bool ok = writeBatch(batch);
+
+            lock.lock();
+            flushing = false;
+            if (ok) {
+                fileSize += batch.size();
+                durable = target;
+            } else {
+                fail();
+            }
+            flushed.notify_all();
+            if (!ok) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool commitAll() {
+        uint64_t lsn;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            lsn = appended;
+        }
+        return commit(lsn);
+    }
+
+    // Начинает новый файл журнала. Накопленные записи дописываются в старый файл;
+    // checkpointResults - число результатов в хранилище на момент переключения.
+    // Возвращает номер нового файла или 0 при ошибке.
+    uint64_t rotate(uint64_t checkpointResults) {
+        std::unique_lock<std::mutex> lock(mutex);
+        flushed.wait(lock, [this] { return !flushing; });
+        if (fd < 0 || failed) {
+            return 0;
+        }
+        if (!writeBatch(pending)) {
+            fail();
+            flushed.notify_all();
+            return 0;
+        }
+        // Записи уже в старом файле: если новый создать не удастся, следующая фиксация
+        // не должна записать их второй раз.
+        fileSize += pending.size();
+        pending.clear();
+        durable = appended;
+        flushed.notify_all();
+        int newFd = createSegment(sequence + 1, checkpointResults);
+        if (newFd < 0) {
+            return 0;
+        }
+        ::close(fd);
+        fd = newFd;
+        fileSize = sizeof(FileHeader);
+        return ++sequence;
+    }
+
+    // Удаляет файлы журнала, все изменения из которых уже есть в хранилищах на диске.
+    void dropBefore(uint64_t number) {
+        for (uint64_t existing : segments()) {
+            if (existing < number) {
+                ::unlink(segmentPath(existing).c_str());
+            }
+        }
+    }
+
+    // Читает файлы журнала по порядку, каждый до первой поврежденной записи. Перед записями
+    // вызывается onCheckpoint с числом результатов, сброшенных на диск в контрольной точке,
+    // с которой начинается самый старый файл.
+    template <typename OnCheckpoint, typename OnRegistration, typename OnResult>
+    uint64_t replay(OnCheckpoint onCheckpoint, OnRegistration onRegistration, OnResult onResult) {
+        uint64_t replayed = 0;
+        bool first = true;
+        for (uint64_t number : segments()) {
+            int segmentFd = ::open(segmentPath(number).c_str(), O_RDONLY);
+            struct stat st {};
+            if (segmentFd < 0 || fstat(segmentFd, &st) < 0 || st.st_size < static_cast<off_t>(sizeof(FileHeader))) {
+                if (segmentFd >= 0) {
+                    ::close(segmentFd);
+                }
+                continue;
+            }
+            std::vector<char> data(static_cast<size_t>(st.st_size));
+            ssize_t got = pread(segmentFd, data.data(), data.size(), 0);
+            ::close(segmentFd);
+            FileHeader header {};
+            std::memcpy(&header, data.data(), sizeof(header));
+            if (got != static_cast<ssize_t>(data.size()) || std::memcmp(header.magic, "ANXWAL01", 8) != 0) {
+                continue;
+            }
+            if (first) {
+                onCheckpoint(header.checkpointResults);
+                first = false;
+            }
+            replayed += replayRecords(data.data() + sizeof(header), data.data() + data.size(),
+                                      onRegistration, onResult);
+        }
+        return replayed;
+    }
+};
+
+#endif //LAB_2_WRITEAHEADLOG_H
@@ -7,10 +7,19 @@
 
 #include <iostream>
 #include "../header/UserManager.h"
+#include <vector>
+#include <string>
+
+std::vector<std::string> getQuestions(const std::string& testType);
+Durability durabilityFromEnvironment();
+std::chrono::microseconds commitDelayFromEnvironment();
 
 void handleRegistration(UserManager& userManager);
 bool handleLogin(UserManager& userManager, std::string& username);
 void handleTesting(UserManager& userManager, const std::string& username);
 void handleUserActions(UserManager& userManager, const std::string& username);
+int handleBatch(UserManager& userManager, const std::string& path);
+int handleServer(UserManager& userManager, const std::string& port);
+int handleQuery(UserManager& userManager, const std::string& query);
 
 #endif //LAB_2_GLOBALFUNCS_H
@@ -3,9 +3,17 @@
 #include "../header/AnxietyCopingSuggestions.h"
 #include "../header/PersonalAnxietyTest.h"
 #include "../header/UserManager.h"
+#include "../header/BatchScorer.h"
+#include "../header/TestServer.h"
 #include <iostream>
 #include <limits>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <sstream>
+#include <chrono>
+#include <arpa/inet.h>
 
 using namespace std;
 
@@ -41,6 +49,18 @@ std::vector<std::string> getQuestions(const std::string& testType) {
     }
 }
 
+// ANXIETY_DURABILITY=none отключает fsync журнала; ANXIETY_COMMIT_DELAY_US задает,
+// сколько микросекунд ведущий поток собирает записи перед общим fsync.
+Durability durabilityFromEnvironment() {
+    const char* value = std::getenv("ANXIETY_DURABILITY");
+    return value != nullptr && std::string(value) == "none" ? Durability::None : Durability::Group;
+}
+
+std::chrono::microseconds commitDelayFromEnvironment() {
+    const char* value = std::getenv("ANXIETY_COMMIT_DELAY_US");
+    return std::chrono::microseconds(value != nullptr ? std::atoi(value) : 0);
+}
+
 void handleRegistration(UserManager& userManager) {
     std::string username, password;
 
@@ -93,6 +113,7 @@ void handleTesting(UserManager& userManager, const std::string& username) {
 
     userManager.saveTestResult(username, situationalScore, personalScore);
     userManager.compareResults(username, situationalScore, personalScore);
+    userManager.comparePopulation(situationalScore, personalScore);
 }
 
 void handleUserActions(UserManager& userManager, const std::string& username) {
@@ -106,4 +127,136 @@ void handleUserActions(UserManager& userManager, const std::string& username) {
     } else if (action == 2) {
         userManager.viewTestHistory(username);
     }
-}
\ No newline at end of file
+}
+
+int handleBatch(UserManager& userManager, const std::string& path) {
+    FILE* input = path == "-" ? stdin : std::fopen(path.c_str(), "rb");
+    if (input == nullptr) {
+        cout << "Не удалось открыть файл " << path << "\n";
+        return 1;
+    }
+    BatchScorer scorer(userManager, std::thread::hardware_concurrency());
+    bool ok = scorer.run(input);
+    if (input != stdin) {
+        std::fclose(input);
+    }
+    return ok ? 0 : 1;
+}
+
+int handleServer(UserManager& userManager, const std::string& port) {
+    int number = std::atoi(port.c_str());
+    if (number <= 0 || number > 65535) {
+        cout << "Некорректный порт: " << port << "\n";
+        return 1;
+    }
+    // ANXIETY_LISTEN задает адрес, на котором слушает сервер; по умолчанию 127.0.0.1.
+    in_addr listenAddress {};
+    listenAddress.s_addr = htonl(INADDR_LOOPBACK);
+    const char* address = std::getenv("ANXIETY_LISTEN");
+    if (address != nullptr && inet_pton(AF_INET, address, &listenAddress) != 1) {
+        cout << "Некорректный адрес: " << address << "\n";
+        return 1;
+    }
+    unsigned threads = std::thread::hardware_concurrency();
+    if (threads == 0) {
+        threads = 1;
+    }
+    std::vector<std::thread> loops;
+    std::atomic<bool> failed(false);
+    for (unsigned i = 0; i < threads; i++) {
+        loops.emplace_back([&userManager, &failed, number, listenAddress] {
+            TestServer server(userManager, static_cast<uint16_t>(number), ntohl(listenAddress.s_addr));
+            if (!server.run()) {
+                failed = true;
+            }
+        });
+    }
+    cout << "Сервер тестирования слушает порт " << number << " (потоков: " << threads << ")\n";
+    for (std::thread& loop : loops) {
+        loop.join();
+    }
+    return failed ? 1 : 0;
+}
+
+// Фильтр вида "situational=high personal=low month=2026-09 users": уровни low, medium, high;
+// месяцы задаются month, from и to в формате ГГГГ-ММ; users - считать и пользователей.
+static bool parseCohortFilter(const std::string& text, CohortFilter& filter) {
+    std::istringstream tokens(text);
+    std::string token;
+    while (tokens >> token) {
+        if (token == "users") {
+            filter.distinctUsers = true;
+            continue;
+        }
+        size_t equals = token.find('=');
+        if (equals == std::string::npos) {
+            return false;
+        }
+        std::string key = token.substr(0, equals);
+        std::string value = token.substr(equals + 1);
+        if (key == "situational" || key == "personal") {
+            AnxietyBand band;
+            if (value == "low") {
+                band = AnxietyBand::Low;
+            } else if (value == "medium") {
+                band = AnxietyBand::Medium;
+            } else if (value == "high") {
+                band = AnxietyBand::High;
+            } else {
+                return false;
+            }
+            (key == "situational" ? filter.situational : filter.personal) = band;
+        } else if (key == "month" || key == "from" || key == "to") {
+            int year, month;
+            char tail;
+            if (std::sscanf(value.c_str(), "%d-%d%c", &year, &month, &tail) != 2 || month < 1 || month > 12) {
+                return false;
+            }
+            int cohort = (year - PercentileIndex::firstYear) * 12 + month - 1;
+            if (cohort < 0 || cohort >= PercentileIndex::cohortCount) {
+                return false;
+            }
+            if (key != "to") {
+                filter.fromMonth = cohort;
+            }
+            if (key != "from") {
+                filter.toMonth = cohort;
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void runQuery(UserManager& userManager, const std::string& text) {
+    CohortFilter filter;
+    if (!parseCohortFilter(text, filter)) {
+        cout << "Некорректный запрос: " << text << "\n";
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    CohortCount count = userManager.countResults(filter);
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    cout << "Результатов: " << count.results;
+    if (filter.distinctUsers) {
+        cout << ", пользователей: " << count.users;
+    }
+    cout << " (" << elapsed << " мс)\n";
+}
+
+int handleQuery(UserManager& userManager, const std::string& query) {
+    // Битовые карты и столбец пользователей строятся при первом обращении; время запросов - без этого.
+    userManager.countResults(CohortFilter());
+    if (query != "-") {
+        runQuery(userManager, query);
+        return 0;
+    }
+    std::string line;
+    while (std::getline(cin, line)) {
+        if (!line.empty()) {
+            runQuery(userManager, line);
+        }
+    }
+    return 0;
+}
@@ -16,9 +16,22 @@ using std::cout;
 using std::cin;
 using std::endl;
 
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc == 3 && std::string(argv[1]) == "--batch") {
+        UserManager userManager(durabilityFromEnvironment(), commitDelayFromEnvironment());
+        return handleBatch(userManager, argv[2]);
+    }
+    if (argc == 3 && std::string(argv[1]) == "--server") {
+        UserManager userManager(durabilityFromEnvironment(), commitDelayFromEnvironment());
+        return handleServer(userManager, argv[2]);
+    }
+    if (argc == 3 && std::string(argv[1]) == "--query") {
+        UserManager userManager(durabilityFromEnvironment(), commitDelayFromEnvironment());
+        return handleQuery(userManager, argv[2]);
+    }
+
     system("chcp 65001");
-    UserManager userManager;
+    UserManager userManager(durabilityFromEnvironment(), commitDelayFromEnvironment());
     int choice;
 
     cout << "Добро пожаловать в тест на тревожность!\n";
@@ -0,0 +1,437 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <wchar.h>
+#include <sys/wait.h>
+#include <X11/Xlib.h>
+#include <X11/XKBlib.h>
+#ifdef HAVE_WAYLAND
+#include <wayland-client.h>
+#endif
+#include "backend.h"
+#include "utils.h"
+#include "metrics.h"
+
+static void x11_dispatch(Backend *backend) {
+    while (XPending(backend->display)) {
+        XEvent ev;
+        XNextEvent(backend->display, &ev);
+        if (ev.type != backend->xkb_event_base) continue;
+        XkbEvent *xkb_ev = (XkbEvent *)&ev;
+        if (xkb_ev->any.xkb_type == XkbStateNotify) {
+            backend->layout = xkb_ev->state.group;
+            wprintf(L"X11 layout changed: %d (%ls)\n", backend->layout, backend->layout == 0 ? L"us" : L"ru");
+        }
+    }
+}
+
+static bool x11_set_layout(Backend *backend, int group) {
+    metrics_inc(METRIC_X11_CALLS);
+    if (!XkbLockGroup(backend->display, XkbUseCoreKbd, group)) return false;
+    XFlush(backend->display);
+    backend->layout = group;
+    return true;
+}
+
+static void x11_close(Backend *backend) {
+    XkbSelectEventDetails(backend->display, XkbUseCoreKbd, XkbStateNotify, XkbGroupStateMask, 0);
+}
+
+bool backend_open_x11(Backend *backend, Display *display) {
+    memset(backend, 0, sizeof(*backend));
+    int opcode, error_base, major = XkbMajorVersion, minor = XkbMinorVersion;
+    if (!display || !XkbQueryExtension(display, &opcode, &backend->xkb_event_base, &error_base, &major, &minor)) {
+        return false;
+    }
+    if (!XkbSelectEventDetails(display, XkbUseCoreKbd, XkbStateNotify, XkbGroupStateMask, XkbGroupStateMask)) {
+        return false;
+    }
+    XkbStateRec state;
+    metrics_inc(METRIC_X11_CALLS);
+    if (XkbGetState(display, XkbUseCoreKbd, &state) != Success) return false;
+
+    backend->name = "x11";
+    backend->display = display;
+    backend->fd = ConnectionNumber(display);
+    backend->layout = state.group;
+    backend->dispatch = x11_dispatch;
+    backend->set_layout = x11_set_layout;
+    backend->close = x11_close;
+    return true;
+}
+
+static void gsettings_dispatch(Backend *backend) {
+    char buffer[256];
+    ssize_t n;
+    while ((n = read(backend->fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            if (buffer[i] != '\n') {
+                if (backend->line_len < sizeof(backend->line) - 1) backend->line[backend->line_len++] = buffer[i];
+                continue;
+            }
+            backend->line[backend->line_len] = '\0';
+            const char *value = strstr(backend->line, "uint32 ");
+            if (value) {
+                backend->layout = atoi(value + 7);
+                wprintf(L"gsettings layout changed: %d (%ls)\n", backend->layout, backend->layout == 0 ? L"us" : L"ru");
+            }
+            backend->line_len = 0;
+        }
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        // The monitor is gone: drop the backend so update_system_layout() falls back to polling.
+        wprintf(L"gsettings monitor stopped, polling layout instead\n");
+        backend_close(backend);
+    }
+}
+
+static void gsettings_close(Backend *backend) {
+    close(backend->fd);
+    kill(backend->monitor_pid, SIGTERM);
+    waitpid(backend->monitor_pid, NULL, 0);
+}
+
+bool backend_open_gsettings(Backend *backend) {
+    memset(backend, 0, sizeof(*backend));
+    int layout = get_gsettings_layout_group();
+    if (layout < 0) return false;
+
+    int pipe_fds[2];
+    if (pipe(pipe_fds) < 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        dup2(pipe_fds[1], STDOUT_FILENO);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        execlp("gsettings", "gsettings", "monitor", "org.gnome.desktop.input-sources", "current", (char *)NULL);
+        _exit(127);
+    }
+    close(pipe_fds[1]);
+    fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(pipe_fds[0], F_SETFD, FD_CLOEXEC);
+
+    backend->name = "gsettings";
+    backend->fd = pipe_fds[0];
+    backend->layout = layout;
+    backend->monitor_pid = pid;
+    backend->dispatch = gsettings_dispatch;
+    backend->close = gsettings_close;
+    return true;
+}
+
+#ifdef HAVE_WAYLAND
+// No generated protocol headers: only the interfaces and messages this backend uses
+// (input-method-unstable-v2 and virtual-keyboard-unstable-v1), in wayland-scanner layout.
+static const struct wl_interface zwp_input_method_v2_interface;
+static const struct wl_interface zwp_input_method_keyboard_grab_v2_interface;
+static const struct wl_interface zwp_virtual_keyboard_v1_interface;
+
+static const struct wl_interface *get_input_method_types[] = { &wl_seat_interface, &zwp_input_method_v2_interface };
+static const struct wl_interface *grab_keyboard_types[] = { &zwp_input_method_keyboard_grab_v2_interface };
+static const struct wl_interface *create_virtual_keyboard_types[] = { &wl_seat_interface, &zwp_virtual_keyboard_v1_interface };
+static const struct wl_interface *no_types[] = { NULL, NULL, NULL, NULL, NULL };
+
+static const struct wl_message input_method_manager_requests[] = {
+    { "get_input_method", "on", get_input_method_types },
+    { "destroy", "", no_types },
+};
+static const struct wl_interface zwp_input_method_manager_v2_interface = {
+    "zwp_input_method_manager_v2", 1, 2, input_method_manager_requests, 0, NULL,
+};
+
+static const struct wl_message input_method_requests[] = {
+    { "commit_string", "s", no_types },
+    { "set_preedit_string", "sii", no_types },
+    { "delete_surrounding_text", "uu", no_types },
+    { "commit", "u", no_types },
+    { "get_input_popup_surface", "no", no_types },
+    { "grab_keyboard", "n", grab_keyboard_types },
+    { "destroy", "", no_types },
+};
+static const struct wl_message input_method_events[] = {
+    { "activate", "", no_types },
+    { "deactivate", "", no_types },
+    { "surrounding_text", "suu", no_types },
+    { "text_change_cause", "u", no_types },
+    { "content_type", "uu", no_types },
+    { "done", "", no_types },
+    { "unavailable", "", no_types },
+};
+static const struct wl_interface zwp_input_method_v2_interface = {
+    "zwp_input_method_v2", 1, 7, input_method_requests, 7, input_method_events,
+};
+
+static const struct wl_message keyboard_grab_requests[] = {
+    { "release", "", no_types },
+};
+static const struct wl_message keyboard_grab_events[] = {
+    { "keymap", "uhu", no_types },
+    { "key", "uuuu", no_types },
+    { "modifiers", "uuuuu", no_types },
+    { "repeat_info", "ii", no_types },
+};
+static const struct wl_interface zwp_input_method_keyboard_grab_v2_interface = {
+    "zwp_input_method_keyboard_grab_v2", 1, 1, keyboard_grab_requests, 4, keyboard_grab_events,
+};
+
+static const struct wl_message virtual_keyboard_manager_requests[] = {
+    { "create_virtual_keyboard", "on", create_virtual_keyboard_types },
+};
+static const struct wl_interface zwp_virtual_keyboard_manager_v1_interface = {
+    "zwp_virtual_keyboard_manager_v1", 1, 1, virtual_keyboard_manager_requests, 0, NULL,
+};
+
+static const struct wl_message virtual_keyboard_requests[] = {
+    { "keymap", "uhu", no_types },
+    { "key", "uuu", no_types },
+    { "modifiers", "uuuu", no_types },
+    { "destroy", "", no_types },
+};
+static const struct wl_interface zwp_virtual_keyboard_v1_interface = {
+    "zwp_virtual_keyboard_v1", 1, 4, virtual_keyboard_requests, 0, NULL,
+};
+
+#define INPUT_METHOD_MANAGER_GET_INPUT_METHOD 0
+#define INPUT_METHOD_MANAGER_DESTROY 1
+#define INPUT_METHOD_GRAB_KEYBOARD 5
+#define INPUT_METHOD_DESTROY 6
+#define KEYBOARD_GRAB_RELEASE 0
+#define VIRTUAL_KEYBOARD_MANAGER_CREATE 0
+#define VIRTUAL_KEYBOARD_KEYMAP 0
+#define VIRTUAL_KEYBOARD_KEY 1
+#define VIRTUAL_KEYBOARD_MODIFIERS 2
+#define VIRTUAL_KEYBOARD_DESTROY 3
+
+struct WaylandBackend {
+    struct wl_display *display;
+    struct wl_registry *registry;
+    struct wl_seat *seat;
+    struct wl_proxy *input_method_manager;
+    struct wl_proxy *virtual_keyboard_manager;
+    struct wl_proxy *input_method;
+    struct wl_proxy *keyboard_grab;
+    struct wl_proxy *virtual_keyboard;
+    bool keymap_sent;
+    bool unavailable;
+    Backend *backend;
+};
+
+static void wayland_global(void *data, struct wl_registry *registry, uint32_t name, const char *interface, uint32_t version) {
+    (void)version;
+    struct WaylandBackend *wl = data;
+    if (!wl->seat && strcmp(interface, "wl_seat") == 0) {
+        wl->seat = wl_registry_bind(registry, name, &wl_seat_interface, 1);
+    } else if (strcmp(interface, zwp_input_method_manager_v2_interface.name) == 0) {
+        wl->input_method_manager = wl_registry_bind(registry, name, &zwp_input_method_manager_v2_interface, 1);
+    } else if (strcmp(interface, zwp_virtual_keyboard_manager_v1_interface.name) == 0) {
+        wl->virtual_keyboard_manager = wl_registry_bind(registry, name, &zwp_virtual_keyboard_manager_v1_interface, 1);
+    }
+}
+
+static void wayland_global_remove(void *data, struct wl_registry *registry, uint32_t name) {
+    (void)data;
+    (void)registry;
+    (void)name;
+}
+
+static const struct wl_registry_listener registry_listener = { wayland_global, wayland_global_remove };
+
+static void input_method_ignore(void *data, struct wl_proxy *input_method) {
+    (void)data;
+    (void)input_method;
+}
+
+static void input_method_surrounding_text(void *data, struct wl_proxy *input_method, const char *text, uint32_t cursor, uint32_t anchor) {
+    (void)data;
+    (void)input_method;
+    (void)text;
+    (void)cursor;
+    (void)anchor;
+}
+
+static void input_method_text_change_cause(void *data, struct wl_proxy *input_method, uint32_t cause) {
+    (void)data;
+    (void)input_method;
+    (void)cause;
+}
+
+static void input_method_content_type(void *data, struct wl_proxy *input_method, uint32_t hint, uint32_t purpose) {
+    (void)data;
+    (void)input_method;
+    (void)hint;
+    (void)purpose;
+}
+
+static void input_method_unavailable(void *data, struct wl_proxy *input_method) {
+    (void)input_method;
+    struct WaylandBackend *wl = data;
+    wl->unavailable = true;
+}
+
+static const struct {
+    void (*activate)(void *, struct wl_proxy *);
+    void (*deactivate)(void *, struct wl_proxy *);
+    void (*surrounding_text)(void *, struct wl_proxy *, const char *, uint32_t, uint32_t);
+    void (*text_change_cause)(void *, struct wl_proxy *, uint32_t);
+    void (*content_type)(void *, struct wl_proxy *, uint32_t, uint32_t);
+    void (*done)(void *, struct wl_proxy *);
+    void (*unavailable)(void *, struct wl_proxy *);
+} input_method_listener = {
+    input_method_ignore, input_method_ignore, input_method_surrounding_text, input_method_text_change_cause,
+    input_method_content_type, input_method_ignore, input_method_unavailable,
+};
+
+// The grab takes the seat's keys away from the focused client, so every event is passed on
+// through the virtual keyboard with the same keymap and modifiers.
+static void grab_keymap(void *data, struct wl_proxy *grab, uint32_t format, int32_t fd, uint32_t size) {
+    (void)grab;
+    struct WaylandBackend *wl = data;
+    wl_proxy_marshal_flags(wl->virtual_keyboard, VIRTUAL_KEYBOARD_KEYMAP, NULL,
+                           wl_proxy_get_version(wl->virtual_keyboard), 0, format, fd, size);
+    close(fd);
+    wl->keymap_sent = true;
+}
+
+static void grab_key(void *data, struct wl_proxy *grab, uint32_t serial, uint32_t time, uint32_t key, uint32_t state) {
+    (void)grab;
+    (void)serial;
+    struct WaylandBackend *wl = data;
+    if (!wl->keymap_sent) return;
+    wl_proxy_marshal_flags(wl->virtual_keyboard, VIRTUAL_KEYBOARD_KEY, NULL,
+                           wl_proxy_get_version(wl->virtual_keyboard), 0, time, key, state);
+}
+
+static void grab_modifiers(void *data, struct wl_proxy *grab, uint32_t serial, uint32_t depressed, uint32_t latched, uint32_t locked, uint32_t group) {
+    (void)grab;
+    (void)serial;
+    struct WaylandBackend *wl = data;
+    if (wl->keymap_sent) {
+        wl_proxy_marshal_flags(wl->virtual_keyboard, VIRTUAL_KEYBOARD_MODIFIERS, NULL,
+                               wl_proxy_get_version(wl->virtual_keyboard), 0, depressed, latched, locked, group);
+    }
+    if ((int)group != wl->backend->layout) {
+        wl->backend->layout = (int)group;
+        wprintf(L"Wayland layout changed: %d (%ls)\n", wl->backend->layout, wl->backend->layout == 0 ? L"us" : L"ru");
+    }
+}
+
+static void grab_repeat_info(void *data, struct wl_proxy *grab, int32_t rate, int32_t delay) {
+    (void)data;
+    (void)grab;
+    (void)rate;
+    (void)delay;
+}
+
+static const struct {
+    void (*keymap)(void *, struct wl_proxy *, uint32_t, int32_t, uint32_t);
+    void (*key)(void *, struct wl_proxy *, uint32_t, uint32_t, uint32_t, uint32_t);
+    void (*modifiers)(void *, struct wl_proxy *, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t);
+    void (*repeat_info)(void *, struct wl_proxy *, int32_t, int32_t);
+} keyboard_grab_listener = { grab_keymap, grab_key, grab_modifiers, grab_repeat_info };
+
+static void wayland_dispatch(Backend *backend) {
+    struct WaylandBackend *wl = backend->wayland;
+    if (wl_display_dispatch(wl->display) < 0 || wl->unavailable) {
+        // Another input method owns the seat or the compositor is gone: fall back to polling.
+        wprintf(L"Wayland input method unavailable, polling layout instead\n");
+        backend_close(backend);
+        return;
+    }
+    wl_display_flush(wl->display);
+}
+
+static void wayland_close(Backend *backend) {
+    struct WaylandBackend *wl = backend->wayland;
+    if (!wl) return;
+    if (wl->keyboard_grab) {
+        wl_proxy_marshal_flags(wl->keyboard_grab, KEYBOARD_GRAB_RELEASE, NULL,
+                               wl_proxy_get_version(wl->keyboard_grab), WL_MARSHAL_FLAG_DESTROY);
+    }
+    if (wl->input_method) {
+        wl_proxy_marshal_flags(wl->input_method, INPUT_METHOD_DESTROY, NULL,
+                               wl_proxy_get_version(wl->input_method), WL_MARSHAL_FLAG_DESTROY);
+    }
+    if (wl->virtual_keyboard) {
+        wl_proxy_marshal_flags(wl->virtual_keyboard, VIRTUAL_KEYBOARD_DESTROY, NULL,
+                               wl_proxy_get_version(wl->virtual_keyboard), WL_MARSHAL_FLAG_DESTROY);
+    }
+    if (wl->input_method_manager) {
+        wl_proxy_marshal_flags(wl->input_method_manager, INPUT_METHOD_MANAGER_DESTROY, NULL,
+                               wl_proxy_get_version(wl->input_method_manager), WL_MARSHAL_FLAG_DESTROY);
+    }
+    if (wl->virtual_keyboard_manager) wl_proxy_destroy(wl->virtual_keyboard_manager);
+    if (wl->seat) wl_seat_destroy(wl->seat);
+    if (wl->registry) wl_registry_destroy(wl->registry);
+    wl_display_flush(wl->display);
+    wl_display_disconnect(wl->display);
+    free(wl);
+}
+
+bool backend_open_wayland(Backend *backend) {
+    memset(backend, 0, sizeof(*backend));
+    backend->layout = -1;
+    struct WaylandBackend *wl = calloc(1, sizeof(*wl));
+    if (!wl) return false;
+    wl->backend = backend;
+    backend->wayland = wl;
+    backend->close = wayland_close;
+
+    wl->display = wl_display_connect(NULL);
+    if (!wl->display) {
+        free(wl);
+        backend->wayland = NULL;
+        return false;
+    }
+    wl->registry = wl_display_get_registry(wl->display);
+    wl_registry_add_listener(wl->registry, &registry_listener, wl);
+    if (wl_display_roundtrip(wl->display) < 0 || !wl->seat || !wl->input_method_manager || !wl->virtual_keyboard_manager) {
+        backend_close(backend);
+        return false;
+    }
+
+    wl->virtual_keyboard = wl_proxy_marshal_flags(wl->virtual_keyboard_manager, VIRTUAL_KEYBOARD_MANAGER_CREATE,
+                                                  &zwp_virtual_keyboard_v1_interface,
+                                                  wl_proxy_get_version(wl->virtual_keyboard_manager), 0, wl->seat, NULL);
+    wl->input_method = wl_proxy_marshal_flags(wl->input_method_manager, INPUT_METHOD_MANAGER_GET_INPUT_METHOD,
+                                              &zwp_input_method_v2_interface,
+                                              wl_proxy_get_version(wl->input_method_manager), 0, wl->seat, NULL);
+    wl_proxy_add_listener(wl->input_method, (void (**)(void))&input_method_listener, wl);
+    wl->keyboard_grab = wl_proxy_marshal_flags(wl->input_method, INPUT_METHOD_GRAB_KEYBOARD,
+                                               &zwp_input_method_keyboard_grab_v2_interface,
+                                               wl_proxy_get_version(wl->input_method), 0, NULL);
+    wl_proxy_add_listener(wl->keyboard_grab, (void (**)(void))&keyboard_grab_listener, wl);
+    // The compositor answers the grab with the keymap and the current modifiers, group included.
+    if (wl_display_roundtrip(wl->display) < 0 || wl->unavailable) {
+        backend_close(backend);
+        return false;
+    }
+    // The forwarded keymap was only queued while the roundtrip dispatched the grab's events.
+    wl_display_flush(wl->display);
+
+    backend->name = "wayland";
+    backend->fd = wl_display_get_fd(wl->display);
+    backend->dispatch = wayland_dispatch;
+    return true;
+}
+#else
+bool backend_open_wayland(Backend *backend) {
+    (void)backend;
+    return false;
+}
+#endif
+
+void backend_close(Backend *backend) {
+    if (backend->close) backend->close(backend);
+    memset(backend, 0, sizeof(*backend));
+    backend->fd = -1;
+    backend->layout = -1;
+}
@@ -0,0 +1,32 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <X11/Xlib.h>
+
+struct WaylandBackend;
+
+typedef struct Backend {
+    const char *name;
+    int fd;
+    int layout;
+    Display *display;
+    int xkb_event_base;
+    pid_t monitor_pid;
+    char line[256];
+    size_t line_len;
+    struct WaylandBackend *wayland;
+    void (*dispatch)(struct Backend *backend);
+    bool (*set_layout)(struct Backend *backend, int group);
+    void (*close)(struct Backend *backend);
+} Backend;
+
+bool backend_open_x11(Backend *backend, Display *display);
+bool backend_open_gsettings(Backend *backend);
+// Needs a compositor with zwp_input_method_v2 and zwp_virtual_keyboard_v1 (wlroots-based ones)
+// and a build with -DHAVE_WAYLAND -lwayland-client; otherwise always fails.
+bool backend_open_wayland(Backend *backend);
+void backend_close(Backend *backend);
+
+#endif
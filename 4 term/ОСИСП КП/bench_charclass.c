@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <locale.h>
+#include <time.h>
+#include "charclass.h"
+
+#define CORPUS_CHARS (64 * 1024 * 1024)
+#define WORD_CHARS 8
+#define ROUNDS 10
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run(void (*fn)(const wchar_t *, size_t, ScriptCounts *), const wchar_t *corpus, ScriptCounts *total) {
+    total->en = total->ru = total->other = 0;
+    double start = now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (size_t off = 0; off < CORPUS_CHARS; off += WORD_CHARS) {
+            ScriptCounts counts;
+            fn(corpus + off, WORD_CHARS, &counts);
+            total->en += counts.en;
+            total->ru += counts.ru;
+            total->other += counts.other;
+        }
+    }
+    return now() - start;
+}
+
+int main(void) {
+    setlocale(LC_ALL, "");
+    const wchar_t *alphabet = L"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                              L"абвгдежзийклмнопрстуфхцчшщъыьэюяАБВГДЕЖЗИЙКЛМНОПРСТУФХЦЧШЩЪЫЬЭЮЯ"
+                              L"0123456789.,;'[]ёЁ";
+    size_t alphabet_len = wcslen(alphabet);
+    wchar_t *corpus = malloc(CORPUS_CHARS * sizeof(wchar_t));
+    if (!corpus) {
+        perror("malloc");
+        return 1;
+    }
+    srand(42);
+    for (size_t i = 0; i < CORPUS_CHARS; i++) {
+        corpus[i] = alphabet[rand() % alphabet_len];
+    }
+
+    ScriptCounts scalar_total, simd_total;
+    double scalar_time = run(count_scripts_scalar, corpus, &scalar_total);
+    double simd_time = run(count_scripts, corpus, &simd_total);
+
+    double mchars = (double)CORPUS_CHARS * ROUNDS / 1e6;
+    wprintf(L"scalar: %.3f s (%.0f Mchar/s)\n", scalar_time, mchars / scalar_time);
+    wprintf(L"%hs: %.3f s (%.0f Mchar/s), speedup %.2fx\n", count_scripts_impl(), simd_time,
+            mchars / simd_time, scalar_time / simd_time);
+    if (scalar_total.en != simd_total.en || scalar_total.ru != simd_total.ru) {
+        wprintf(L"Mismatch: scalar en=%zu ru=%zu, simd en=%zu ru=%zu\n",
+                scalar_total.en, scalar_total.ru, simd_total.en, simd_total.ru);
+        free(corpus);
+        return 1;
+    }
+    free(corpus);
+    return 0;
+}
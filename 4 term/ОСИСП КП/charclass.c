@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include "charclass.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+#define CYR_FIRST 0x0410
+#define CYR_LAST 0x044F
+
+static inline int is_latin(wchar_t c) {
+    return (c | 0x20) >= L'a' && (c | 0x20) <= L'z';
+}
+
+static inline int is_cyrillic(wchar_t c) {
+    return c >= CYR_FIRST && c <= CYR_LAST;
+}
+
+void count_scripts_scalar(const wchar_t *text, size_t len, ScriptCounts *counts) {
+    size_t en = 0, ru = 0;
+    for (size_t i = 0; i < len; i++) {
+        en += is_latin(text[i]);
+        ru += is_cyrillic(text[i]);
+    }
+    counts->en = en;
+    counts->ru = ru;
+    counts->other = len - en - ru;
+}
+
+#ifdef HAVE_X86_SIMD
+/* wchar_t is 32-bit here: one SSE2 register holds 4 code points, AVX2 holds 8.
+   Lanes that match a range compare to -1, so subtracting the mask counts them. */
+__attribute__((target("sse2")))
+static void count_scripts_sse2(const wchar_t *text, size_t len, ScriptCounts *counts) {
+    const __m128i case_bit = _mm_set1_epi32(0x20);
+    const __m128i lat_lo = _mm_set1_epi32(L'a' - 1);
+    const __m128i lat_hi = _mm_set1_epi32(L'z' + 1);
+    const __m128i cyr_lo = _mm_set1_epi32(CYR_FIRST - 1);
+    const __m128i cyr_hi = _mm_set1_epi32(CYR_LAST + 1);
+    __m128i en_acc = _mm_setzero_si128();
+    __m128i ru_acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(text + i));
+        __m128i folded = _mm_or_si128(c, case_bit);
+        __m128i lat = _mm_and_si128(_mm_cmpgt_epi32(folded, lat_lo), _mm_cmplt_epi32(folded, lat_hi));
+        __m128i cyr = _mm_and_si128(_mm_cmpgt_epi32(c, cyr_lo), _mm_cmplt_epi32(c, cyr_hi));
+        en_acc = _mm_sub_epi32(en_acc, lat);
+        ru_acc = _mm_sub_epi32(ru_acc, cyr);
+    }
+    int en_lanes[4], ru_lanes[4];
+    _mm_storeu_si128((__m128i *)en_lanes, en_acc);
+    _mm_storeu_si128((__m128i *)ru_lanes, ru_acc);
+    ScriptCounts tail;
+    count_scripts_scalar(text + i, len - i, &tail);
+    counts->en = tail.en + (size_t)en_lanes[0] + en_lanes[1] + en_lanes[2] + en_lanes[3];
+    counts->ru = tail.ru + (size_t)ru_lanes[0] + ru_lanes[1] + ru_lanes[2] + ru_lanes[3];
+    counts->other = len - counts->en - counts->ru;
+}
+
+__attribute__((target("avx2")))
+static void count_scripts_avx2(const wchar_t *text, size_t len, ScriptCounts *counts) {
+    const __m256i case_bit = _mm256_set1_epi32(0x20);
+    const __m256i lat_lo = _mm256_set1_epi32(L'a' - 1);
+    const __m256i lat_hi = _mm256_set1_epi32(L'z' + 1);
+    const __m256i cyr_lo = _mm256_set1_epi32(CYR_FIRST - 1);
+    const __m256i cyr_hi = _mm256_set1_epi32(CYR_LAST + 1);
+    __m256i en_acc = _mm256_setzero_si256();
+    __m256i ru_acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(text + i));
+        __m256i folded = _mm256_or_si256(c, case_bit);
+        __m256i lat = _mm256_and_si256(_mm256_cmpgt_epi32(folded, lat_lo), _mm256_cmpgt_epi32(lat_hi, folded));
+        __m256i cyr = _mm256_and_si256(_mm256_cmpgt_epi32(c, cyr_lo), _mm256_cmpgt_epi32(cyr_hi, c));
+        en_acc = _mm256_sub_epi32(en_acc, lat);
+        ru_acc = _mm256_sub_epi32(ru_acc, cyr);
+    }
+    int en_lanes[8], ru_lanes[8];
+    _mm256_storeu_si256((__m256i *)en_lanes, en_acc);
+    _mm256_storeu_si256((__m256i *)ru_lanes, ru_acc);
+    ScriptCounts tail;
+    count_scripts_scalar(text + i, len - i, &tail);
+    counts->en = tail.en;
+    counts->ru = tail.ru;
+    for (int lane = 0; lane < 8; lane++) {
+        counts->en += en_lanes[lane];
+        counts->ru += ru_lanes[lane];
+    }
+    counts->other = len - counts->en - counts->ru;
+}
+#endif
+
+typedef void (*count_fn)(const wchar_t *, size_t, ScriptCounts *);
+
+static count_fn selected_impl = NULL;
+static const char *selected_name = "scalar";
+
+static void select_impl(void) {
+    selected_impl = count_scripts_scalar;
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        selected_impl = count_scripts_avx2;
+        selected_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        selected_impl = count_scripts_sse2;
+        selected_name = "sse2";
+    }
+#endif
+}
+
+void count_scripts(const wchar_t *text, size_t len, ScriptCounts *counts) {
+    if (!selected_impl) select_impl();
+    selected_impl(text, len, counts);
+}
+
+const char *count_scripts_impl(void) {
+    if (!selected_impl) select_impl();
+    return selected_name;
+}
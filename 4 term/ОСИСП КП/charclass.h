@@ -0,0 +1,17 @@
+#ifndef CHARCLASS_H
+#define CHARCLASS_H
+
+#include <wchar.h>
+#include <stddef.h>
+
+typedef struct {
+    size_t en;
+    size_t ru;
+    size_t other;
+} ScriptCounts;
+
+void count_scripts(const wchar_t *text, size_t len, ScriptCounts *counts);
+void count_scripts_scalar(const wchar_t *text, size_t len, ScriptCounts *counts);
+const char *count_scripts_impl(void);
+
+#endif
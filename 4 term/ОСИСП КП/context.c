@@ -0,0 +1,32 @@
+#include <stdio.h>
+#include <wchar.h>
+#include "context.h"
+
+void context_push(WordContext *context, int lang) {
+    context->langs[context->next] = lang;
+    context->next = (context->next + 1) % CONTEXT_SIZE;
+    if (context->count < CONTEXT_SIZE) context->count++;
+}
+
+int context_count(const WordContext *context, int lang) {
+    int n = 0;
+    for (int i = 0; i < context->count; i++) {
+        if (context->langs[i] == lang) n++;
+    }
+    return n;
+}
+
+bool context_should_switch(const WordContext *context, int source_lang, int target_lang, Evidence evidence) {
+    int source = context_count(context, source_lang);
+    int target = context_count(context, target_lang);
+    wprintf(L"Context: source=%d target=%d evidence=%d\n", source, target, evidence);
+    switch (evidence) {
+        case EVIDENCE_STRONG:
+            return true;
+        case EVIDENCE_WEAK:
+            return target >= source;
+        case EVIDENCE_AMBIGUOUS:
+            return target >= CONTEXT_MAJORITY;
+    }
+    return false;
+}
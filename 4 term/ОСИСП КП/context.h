@@ -0,0 +1,25 @@
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <stdbool.h>
+
+#define CONTEXT_SIZE 5
+#define CONTEXT_MAJORITY 3
+
+typedef enum {
+    EVIDENCE_STRONG,
+    EVIDENCE_WEAK,
+    EVIDENCE_AMBIGUOUS
+} Evidence;
+
+typedef struct {
+    int langs[CONTEXT_SIZE];
+    int count;
+    int next;
+} WordContext;
+
+void context_push(WordContext *context, int lang);
+int context_count(const WordContext *context, int lang);
+bool context_should_switch(const WordContext *context, int source_lang, int target_lang, Evidence evidence);
+
+#endif
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <wchar.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "control.h"
+#include "layout.h"
+#include "metrics.h"
+
+#define SD_LISTEN_FDS_START 3
+
+typedef struct {
+    bool open;
+    bool answered;
+    int fd;
+    double deadline;
+    size_t len;
+    char request[128];
+} ControlClient;
+
+static bool socket_activated = false;
+static ControlClient clients[CONTROL_MAX_CLIENTS];
+
+static int systemd_listen_fd(void) {
+    const char *pid = getenv("LISTEN_PID");
+    const char *fds = getenv("LISTEN_FDS");
+    if (!pid || !fds || atoi(pid) != getpid() || atoi(fds) < 1) {
+        return -1;
+    }
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+    // systemd passes the socket without close-on-exec; the gsettings monitor child must not inherit it.
+    int fd = SD_LISTEN_FDS_START;
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0 || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+        perror("Failed to configure control socket passed by systemd");
+    }
+    return fd;
+}
+
+int control_listen(char *path, size_t path_size) {
+    int fd = systemd_listen_fd();
+    if (fd >= 0) {
+        socket_activated = true;
+        path[0] = '\0';
+        wprintf(L"Using control socket passed by systemd\n");
+        return fd;
+    }
+
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    snprintf(path, path_size, "%s/%s", runtime_dir ? runtime_dir : "/tmp", CONTROL_SOCKET_NAME);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Failed to create control socket");
+        return -1;
+    }
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+        perror("Failed to bind control socket");
+        close(fd);
+        return -1;
+    }
+    wprintf(L"Control socket: %hs\n", path);
+    return fd;
+}
+
+// app must be shorter than CONTROL_APP_LEN.
+static bool toggle_app(ControlState *state, const char *app) {
+    for (int i = 0; i < state->disabled_count; i++) {
+        if (strcmp(state->disabled_apps[i], app) == 0) {
+            memmove(state->disabled_apps[i], state->disabled_apps[i + 1],
+                    (state->disabled_count - i - 1) * CONTROL_APP_LEN);
+            state->disabled_count--;
+            return true;
+        }
+    }
+    if (state->disabled_count == CONTROL_MAX_APPS) {
+        return false;
+    }
+    memcpy(state->disabled_apps[state->disabled_count++], app, strlen(app) + 1);
+    return true;
+}
+
+void control_accept(int listen_fd) {
+    int fd;
+    while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+        ControlClient *client = NULL;
+        for (int i = 0; i < CONTROL_MAX_CLIENTS && !client; i++) {
+            if (!clients[i].open) client = &clients[i];
+        }
+        if (!client || fcntl(fd, F_SETFL, O_NONBLOCK) < 0 || fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+            wprintf(L"Dropping control client\n");
+            close(fd);
+            continue;
+        }
+        client->open = true;
+        client->answered = false;
+        client->fd = fd;
+        client->deadline = metrics_now() + CONTROL_CLIENT_TIMEOUT;
+        client->len = 0;
+    }
+}
+
+int control_watch(fd_set *read_fds, int max_fd) {
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        if (!clients[i].open) continue;
+        FD_SET(clients[i].fd, read_fds);
+        if (clients[i].fd > max_fd) max_fd = clients[i].fd;
+    }
+    return max_fd;
+}
+
+static void client_close(ControlClient *client) {
+    close(client->fd);
+    client->open = false;
+}
+
+static void client_execute(ControlClient *client, ControlState *state) {
+    char *request = client->request;
+    request[client->len] = '\0';
+    request[strcspn(request, "\r\n")] = '\0';
+    client->answered = true;
+
+    static char reply[8192];
+    size_t len = 0;
+    if (strcmp(request, "pause") == 0) {
+        state->paused = true;
+        len = snprintf(reply, sizeof(reply), "ok paused\n");
+    } else if (strcmp(request, "resume") == 0) {
+        state->paused = false;
+        len = snprintf(reply, sizeof(reply), "ok resumed\n");
+    } else if (strcmp(request, "reload") == 0) {
+        state->reload_requested = true;
+        len = snprintf(reply, sizeof(reply), "ok reloading\n");
+    } else if (strcmp(request, "stats") == 0) {
+        len = snprintf(reply, sizeof(reply), "paused %d\n", state->paused);
+        len += metrics_format(reply + len, sizeof(reply) - len);
+    } else if (strncmp(request, "toggle ", 7) == 0 && request[7] != '\0') {
+        if (strlen(request + 7) >= CONTROL_APP_LEN) {
+            len = snprintf(reply, sizeof(reply), "error app name longer than %d bytes\n", CONTROL_APP_LEN - 1);
+        } else if (toggle_app(state, request + 7)) {
+            len = snprintf(reply, sizeof(reply), "ok %s\n", request + 7);
+        } else {
+            len = snprintf(reply, sizeof(reply), "error too many disabled apps\n");
+        }
+    } else {
+        len = snprintf(reply, sizeof(reply), "error unknown command: %s\n", request);
+    }
+    wprintf(L"Control command: %hs\n", request);
+
+    if (write(client->fd, reply, len) != (ssize_t)len) {
+        perror("Failed to write control reply");
+        client_close(client);
+        return;
+    }
+    shutdown(client->fd, SHUT_WR);
+}
+
+// Commands are read without blocking the input loop: a command runs once its line
+// (or EOF) has arrived, and the client is then drained until it closes.
+bool control_serve(const fd_set *read_fds, ControlState *state) {
+    bool executed = false;
+    double now = metrics_now();
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        ControlClient *client = &clients[i];
+        if (!client->open) continue;
+        if (FD_ISSET(client->fd, read_fds)) {
+            for (;;) {
+                char scratch[128];
+                bool keep = !client->answered && client->len < sizeof(client->request) - 1;
+                char *dst = keep ? client->request + client->len : scratch;
+                size_t room = keep ? sizeof(client->request) - 1 - client->len : sizeof(scratch);
+                ssize_t n = read(client->fd, dst, room);
+                if (n > 0) {
+                    if (keep) client->len += n;
+                    continue;
+                }
+                if (n == 0) {
+                    if (!client->answered && client->len > 0) {
+                        client_execute(client, state);
+                        executed = true;
+                    }
+                    if (client->open) client_close(client);
+                } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    client_close(client);
+                }
+                break;
+            }
+            if (client->open && !client->answered &&
+                (memchr(client->request, '\n', client->len) || client->len == sizeof(client->request) - 1)) {
+                client_execute(client, state);
+                executed = true;
+            }
+        }
+        if (client->open && now > client->deadline) {
+            client_close(client);
+        }
+    }
+    return executed;
+}
+
+bool control_app_disabled(const ControlState *state, Display *display) {
+    if (state->disabled_count == 0) return false;
+    char app[CONTROL_APP_LEN];
+    if (!get_active_app(display, app, sizeof(app))) return false;
+    for (int i = 0; i < state->disabled_count; i++) {
+        if (strcmp(state->disabled_apps[i], app) == 0) {
+            wprintf(L"Switching disabled for %hs\n", app);
+            return true;
+        }
+    }
+    return false;
+}
+
+void control_close(int listen_fd, const char *path) {
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        if (clients[i].open) client_close(&clients[i]);
+    }
+    if (listen_fd < 0) return;
+    close(listen_fd);
+    if (!socket_activated && path[0]) unlink(path);
+}
@@ -0,0 +1,29 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdbool.h>
+#include <sys/select.h>
+#include <X11/Xlib.h>
+
+#define CONTROL_SOCKET_NAME "layout-switcher.sock"
+#define CONTROL_MAX_APPS 32
+#define CONTROL_APP_LEN 64
+#define CONTROL_MAX_CLIENTS 4
+#define CONTROL_CLIENT_TIMEOUT 1.0
+
+typedef struct {
+    bool paused;
+    bool reload_requested;
+    char disabled_apps[CONTROL_MAX_APPS][CONTROL_APP_LEN];
+    int disabled_count;
+} ControlState;
+
+int control_listen(char *path, size_t path_size);
+void control_accept(int listen_fd);
+int control_watch(fd_set *read_fds, int max_fd);
+// Returns true when a command was executed.
+bool control_serve(const fd_set *read_fds, ControlState *state);
+bool control_app_disabled(const ControlState *state, Display *display);
+void control_close(int listen_fd, const char *path);
+
+#endif
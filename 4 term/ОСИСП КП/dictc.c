@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <wchar.h>
+#include <wctype.h>
+#include <string.h>
+#include <locale.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include "dictimage.h"
+#include "normalize.h"
+
+#define MAX_WORD_LEN 256
+#define MAX_THREADS 64
+
+typedef struct {
+    wchar_t **words;
+    size_t count;
+} Shard;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_words(const void *a, const void *b) {
+    return wcscmp(*(wchar_t *const *)a, *(wchar_t *const *)b);
+}
+
+// Consumes the rest of a line that did not fit the buffer; false if the buffer held the whole last line.
+static bool skip_line_rest(FILE *file) {
+    wint_t c = fgetwc(file);
+    if (c == WEOF) return false;
+    while (c != WEOF && c != L'\n') c = fgetwc(file);
+    return true;
+}
+
+static bool read_words(const char *filename, wchar_t ***words, size_t *count, size_t *cap) {
+    FILE *file = fopen(filename, "r, ccs=UTF-8");
+    if (!file) {
+        fwprintf(stderr, L"Ошибка: Не удалось открыть файл словаря %hs\n", filename);
+        return false;
+    }
+    wchar_t buffer[MAX_WORD_LEN];
+    size_t line = 0;
+    while (fgetws(buffer, MAX_WORD_LEN, file)) {
+        line++;
+        size_t len = wcslen(buffer);
+        if (len == MAX_WORD_LEN - 1 && buffer[len - 1] != L'\n' && skip_line_rest(file)) {
+            fwprintf(stderr, L"%hs:%zu: строка длиннее %d символов пропущена\n", filename, line, MAX_WORD_LEN - 2);
+            continue;
+        }
+        if (*count == *cap) {
+            *cap = *cap ? *cap * 2 : 1 << 16;
+            wchar_t **grown = realloc(*words, *cap * sizeof(wchar_t*));
+            if (!grown) {
+                fclose(file);
+                return false;
+            }
+            *words = grown;
+        }
+        wchar_t *word = wcsdup(buffer);
+        if (!word) {
+            fwprintf(stderr, L"Ошибка: Недостаточно памяти для %hs\n", filename);
+            fclose(file);
+            return false;
+        }
+        (*words)[(*count)++] = word;
+    }
+    fclose(file);
+    return true;
+}
+
+static void normalize_entry(wchar_t *word) {
+    size_t start = 0;
+    while (word[start] && iswspace(word[start])) start++;
+    size_t len = wcslen(word + start);
+    while (len > 0 && iswspace(word[start + len - 1])) len--;
+    memmove(word, word + start, len * sizeof(wchar_t));
+    word[len] = L'\0';
+    normalize_word(word);
+}
+
+static void *build_shard(void *arg) {
+    Shard *shard = arg;
+    size_t kept = 0;
+    for (size_t i = 0; i < shard->count; i++) {
+        normalize_entry(shard->words[i]);
+        if (shard->words[i][0] == L'\0') {
+            free(shard->words[i]);
+            continue;
+        }
+        shard->words[kept++] = shard->words[i];
+    }
+    qsort(shard->words, kept, sizeof(wchar_t*), compare_words);
+    size_t unique = 0;
+    for (size_t i = 0; i < kept; i++) {
+        if (unique > 0 && wcscmp(shard->words[unique - 1], shard->words[i]) == 0) {
+            free(shard->words[i]);
+            continue;
+        }
+        shard->words[unique++] = shard->words[i];
+    }
+    shard->count = unique;
+    return NULL;
+}
+
+static size_t merge_shards(Shard *shards, int shard_count, wchar_t **out) {
+    size_t pos[MAX_THREADS] = {0};
+    size_t count = 0;
+    for (;;) {
+        int best = -1;
+        for (int s = 0; s < shard_count; s++) {
+            if (pos[s] == shards[s].count) continue;
+            if (best < 0 || wcscmp(shards[s].words[pos[s]], shards[best].words[pos[best]]) < 0) best = s;
+        }
+        if (best < 0) break;
+        wchar_t *word = shards[best].words[pos[best]++];
+        if (count > 0 && wcscmp(out[count - 1], word) == 0) {
+            free(word);
+            continue;
+        }
+        out[count++] = word;
+    }
+    return count;
+}
+
+static bool write_image(const char *filename, wchar_t **words, size_t count) {
+    DictImageHeader header = {0};
+    memcpy(header.magic, DICT_IMAGE_MAGIC, 4);
+    header.version = DICT_IMAGE_VERSION;
+    header.count = count;
+    header.char_size = sizeof(wchar_t);
+    for (size_t i = 0; i < count; i++) {
+        size_t len = wcslen(words[i]);
+        header.chars += len + 1;
+        if (len > header.max_len) header.max_len = (uint32_t)len;
+    }
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        perror("Не удалось создать файл образа");
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (size_t i = 0; ok && i < count; i++) {
+        ok = fwrite(words[i], sizeof(wchar_t), wcslen(words[i]) + 1, file) == wcslen(words[i]) + 1;
+    }
+    if (fclose(file) != 0) ok = false;
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    setlocale(LC_ALL, "");
+    if (argc < 3) {
+        fwprintf(stderr, L"Usage: %hs out.dict words.txt [words.txt ...]\n", argv[0]);
+        return 1;
+    }
+
+    double start = now();
+    wchar_t **words = NULL;
+    size_t count = 0, cap = 0;
+    for (int i = 2; i < argc; i++) {
+        if (!read_words(argv[i], &words, &count, &cap)) return 1;
+    }
+    double read_done = now();
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int shard_count = cpus < 1 ? 1 : cpus > MAX_THREADS ? MAX_THREADS : (int)cpus;
+    if ((size_t)shard_count > count) shard_count = count ? (int)count : 1;
+    Shard shards[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    bool started[MAX_THREADS];
+    size_t per_shard = (count + shard_count - 1) / shard_count;
+    for (int s = 0; s < shard_count; s++) {
+        size_t first = s * per_shard;
+        size_t last = first + per_shard < count ? first + per_shard : count;
+        shards[s].words = words + first;
+        shards[s].count = first < last ? last - first : 0;
+        started[s] = pthread_create(&threads[s], NULL, build_shard, &shards[s]) == 0;
+        if (!started[s]) build_shard(&shards[s]);
+    }
+    for (int s = 0; s < shard_count; s++) {
+        if (started[s]) pthread_join(threads[s], NULL);
+    }
+    double sort_done = now();
+
+    wchar_t **merged = malloc((count ? count : 1) * sizeof(wchar_t*));
+    if (!merged) return 1;
+    size_t unique = merge_shards(shards, shard_count, merged);
+    double merge_done = now();
+
+    bool ok = write_image(argv[1], merged, unique);
+    double write_done = now();
+
+    fwprintf(stderr, L"%zu lines -> %zu words, %d threads: read %.2f s, sort %.2f s, merge %.2f s, write %.2f s\n",
+             count, unique, shard_count, read_done - start, sort_done - read_done,
+             merge_done - sort_done, write_done - merge_done);
+    for (size_t i = 0; i < unique; i++) free(merged[i]);
+    free(merged);
+    free(words);
+    return ok ? 0 : 1;
+}
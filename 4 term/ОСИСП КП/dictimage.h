@@ -0,0 +1,18 @@
+#ifndef DICTIMAGE_H
+#define DICTIMAGE_H
+
+#include <stdint.h>
+
+#define DICT_IMAGE_MAGIC "LSWD"
+#define DICT_IMAGE_VERSION 2
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t count;
+    uint64_t chars;
+    uint32_t max_len;
+    uint32_t char_size;
+} DictImageHeader;
+
+#endif
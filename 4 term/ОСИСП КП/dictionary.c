@@ -3,14 +3,84 @@
 #include <wchar.h>
 #include <string.h>
 #include <wctype.h>
+#include <sys/stat.h>
 #include <X11/Xlib.h>
 #include <xkbcommon/xkbcommon.h>
 #include "dictionary.h"
 #include "utils.h"
 #include "io.h"
 #include "layout.h"
+#include "metrics.h"
+#include "morphology.h"
+#include "fuzzy.h"
+#include "context.h"
+#include "dictimage.h"
+#include "normalize.h"
+
+static int compare_words(const void *a, const void *b) {
+    return wcscmp(*(wchar_t *const *)a, *(wchar_t *const *)b);
+}
+
+static int load_dictionary_image(const char *filename, Dictionary *dict) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) return -1;
+    DictImageHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, DICT_IMAGE_MAGIC, 4) != 0) {
+        fclose(file);
+        return -1;
+    }
+    if (header.version != DICT_IMAGE_VERSION || header.char_size != sizeof(wchar_t)) {
+        wprintf(L"Ошибка: Несовместимый образ словаря %hs\n", filename);
+        fclose(file);
+        return 0;
+    }
+    // Every word takes at least one character (its terminator), and the body must fill the rest of the file exactly.
+    struct stat st;
+    if (fstat(fileno(file), &st) < 0 || st.st_size < (off_t)sizeof(header) ||
+        header.chars != (uint64_t)(st.st_size - sizeof(header)) / sizeof(wchar_t) ||
+        (uint64_t)(st.st_size - sizeof(header)) % sizeof(wchar_t) != 0 || header.count > header.chars) {
+        wprintf(L"Ошибка: Поврежденный образ словаря %hs\n", filename);
+        fclose(file);
+        return 0;
+    }
+    dict->image = malloc((header.chars ? header.chars : 1) * sizeof(wchar_t));
+    dict->words = malloc((header.count ? header.count : 1) * sizeof(wchar_t*));
+    if (!dict->image || !dict->words || fread(dict->image, sizeof(wchar_t), header.chars, file) != header.chars) {
+        free(dict->image);
+        free(dict->words);
+        dict->image = NULL;
+        dict->words = NULL;
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+    wchar_t *word = dict->image;
+    wchar_t *end = dict->image + header.chars;
+    size_t max_len = 0;
+    for (size_t i = 0; i < header.count; i++) {
+        wchar_t *terminator = wmemchr(word, L'\0', end - word);
+        if (!terminator) {
+            wprintf(L"Ошибка: Поврежденный образ словаря %hs\n", filename);
+            free(dict->image);
+            free(dict->words);
+            dict->image = NULL;
+            dict->words = NULL;
+            return 0;
+        }
+        dict->words[i] = word;
+        if ((size_t)(terminator - word) > max_len) max_len = terminator - word;
+        word = terminator + 1;
+    }
+    dict->count = header.count;
+    dict->max_len = max_len;
+    wprintf(L"Загружен образ словаря %hs: %zu слов\n", filename, dict->count);
+    return 1;
+}
 
 bool load_dictionary(const char *filename, Dictionary *dict) {
+    int image = load_dictionary_image(filename, dict);
+    if (image >= 0) return image == 1;
+
     FILE *file = fopen(filename, "r, ccs=UTF-8");
     if (!file) {
         wprintf(L"Ошибка: Не удалось открыть файл словаря %hs\n", filename);
@@ -22,6 +92,7 @@ bool load_dictionary(const char *filename, Dictionary *dict) {
         return false;
     }
     dict->count = 0;
+    dict->max_len = 0;
     wchar_t buffer[MAX_WORD_LEN];
     while (fgetws(buffer, MAX_WORD_LEN, file) && dict->count < MAX_DICT_SIZE) {
         size_t len = wcslen(buffer);
@@ -38,32 +109,112 @@ bool load_dictionary(const char *filename, Dictionary *dict) {
             return false;
         }
         wcscpy(dict->words[dict->count], buffer);
+        normalize_word(dict->words[dict->count]);
         dict->count++;
+        if (len > dict->max_len) dict->max_len = len;
     }
     fclose(file);
+
+    qsort(dict->words, dict->count, sizeof(wchar_t*), compare_words);
+    size_t unique = 0;
+    for (size_t i = 0; i < dict->count; i++) {
+        if (unique > 0 && wcscmp(dict->words[unique - 1], dict->words[i]) == 0) {
+            free(dict->words[i]);
+            continue;
+        }
+        dict->words[unique++] = dict->words[i];
+    }
+    dict->count = unique;
     return true;
 }
 
 void free_dictionary(Dictionary *dict) {
-    for (size_t i = 0; i < dict->count; i++) free(dict->words[i]);
+    if (dict->image) {
+        free(dict->image);
+        dict->image = NULL;
+    } else {
+        for (size_t i = 0; i < dict->count; i++) free(dict->words[i]);
+    }
     free(dict->words);
     dict->words = NULL;
     dict->count = 0;
+    if (dict->morph) {
+        free_morphology(dict->morph);
+        free(dict->morph);
+        dict->morph = NULL;
+    }
+    if (dict->fuzzy) {
+        free_fuzzy_index(dict->fuzzy);
+        free(dict->fuzzy);
+        dict->fuzzy = NULL;
+    }
+}
+
+bool attach_morphology(Dictionary *dict, const char *paradigm_file, const char *stem_file) {
+    Morphology *morph = malloc(sizeof(Morphology));
+    if (!morph) return false;
+    if (!load_morphology(paradigm_file, stem_file, morph)) {
+        free(morph);
+        return false;
+    }
+    dict->morph = morph;
+    if (morph->max_word_len > dict->max_len) dict->max_len = morph->max_word_len;
+    return true;
+}
+
+bool attach_fuzzy_index(Dictionary *dict) {
+    FuzzyIndex *fuzzy = malloc(sizeof(FuzzyIndex));
+    if (!fuzzy) return false;
+    if (!build_fuzzy_index(dict->words, dict->count, fuzzy)) {
+        free(fuzzy);
+        return false;
+    }
+    dict->fuzzy = fuzzy;
+    return true;
 }
 
 bool is_in_dict(const wchar_t *word, Dictionary *dict) {
-    for (size_t i = 0; i < dict->count; i++) {
-        if (wcscmp(word, dict->words[i]) == 0) return true;
+    if (dict->count > 0 && bsearch(&word, dict->words, dict->count, sizeof(wchar_t*), compare_words)) return true;
+    return morph_lookup(dict->morph, word);
+}
+
+static WordContext word_context;
+
+const wchar_t *choose_correction(const wchar_t *word_norm, const wchar_t *converted_word, const wchar_t *converted_norm, int layout, Dictionary *eng_dict, Dictionary *rus_dict) {
+    Dictionary *source_dict = layout == 1 ? eng_dict : rus_dict;
+    Dictionary *target_dict = layout == 1 ? rus_dict : eng_dict;
+    int source_lang = layout;
+    int target_lang = layout == 1 ? 2 : 1;
+
+    const wchar_t *target_word = NULL;
+    Evidence evidence = EVIDENCE_STRONG;
+    if (is_in_dict(converted_norm, target_dict)) {
+        target_word = converted_word;
+        if (is_in_dict(word_norm, source_dict)) evidence = EVIDENCE_AMBIGUOUS;
+    } else {
+        target_word = fuzzy_lookup(target_dict->fuzzy, target_dict->words, converted_norm);
+        if (target_word) {
+            wprintf(L"Fuzzy match: %ls -> %ls\n", converted_norm, target_word);
+            evidence = EVIDENCE_WEAK;
+            if (is_in_dict(word_norm, source_dict)) target_word = NULL;
+        }
     }
-    return false;
+
+    if (target_word && !context_should_switch(&word_context, source_lang, target_lang, evidence)) {
+        wprintf(L"Context prefers current layout, keeping %ls\n", word_norm);
+        target_word = NULL;
+    }
+    context_push(&word_context, target_word ? target_lang : source_lang);
+    return target_word;
 }
 
-void process_word(wchar_t *word, Dictionary *eng_dict, Dictionary *rus_dict, int uinput_fd, bool use_super_space, int *system_layout, Display *display, struct xkb_state *xkb_state) {
+bool process_word(wchar_t *word, const wchar_t *word_norm, Dictionary *eng_dict, Dictionary *rus_dict, int uinput_fd, bool use_super_space, int *system_layout, Display *display, struct xkb_state *xkb_state) {
     if (!word || wcslen(word) == 0) {
         wprintf(L"Empty word, skipping\n");
-        return;
+        return false;
     }
 
+    metrics_inc(METRIC_WORDS);
     wprintf(L"Processing word: %ls\n", word);
     update_system_layout(display, system_layout);
     wprintf(L"System layout before processing: %d (%ls)\n", *system_layout, *system_layout == 0 ? L"us" : L"ru");
@@ -75,44 +226,40 @@ void process_word(wchar_t *word, Dictionary *eng_dict, Dictionary *rus_dict, int
         case 2: layout_name = L"Russian"; break;
         case 0:
             wprintf(L"Ambiguous or unsupported word layout, skipping\n");
-            return;
+            return false;
         default:
             wprintf(L"Unexpected layout value, skipping\n");
-            return;
+            return false;
     }
     wprintf(L"Detected layout: %ls\n", layout_name);
 
     wchar_t converted_word[MAX_WORD_LEN];
-    convert_layout(word, converted_word, layout == 1);
+    wchar_t converted_norm[MAX_WORD_LEN];
+    convert_layout(word, converted_word, converted_norm, MAX_WORD_LEN, layout == 1);
 
-    bool word_found = false;
-    const wchar_t *target_word = NULL;
-    bool target_is_russian = false;
+    double lookup_start = metrics_now();
+    bool target_is_russian = layout == 1;
+    const wchar_t *target_word = choose_correction(word_norm, converted_word, converted_norm, layout, eng_dict, rus_dict);
+    bool word_found = target_word != NULL;
 
-    if (layout == 1) {
-        if (is_in_dict(converted_word, rus_dict)) {
-            word_found = true;
-            target_word = converted_word;
-            target_is_russian = true;
-        }
-    } else if (layout == 2) {
-        if (is_in_dict(converted_word, eng_dict)) {
-            word_found = true;
-            target_word = converted_word;
-            target_is_russian = false;
-        }
-    }
+    metrics_observe(HIST_DICT_LOOKUP, metrics_now() - lookup_start);
 
     if (word_found) {
+        double correction_start = metrics_now();
         wprintf(L"Found in %ls dictionary: %ls\n", layout == 1 ? L"Russian" : L"English", target_word);
         select_and_delete_word(uinput_fd, wcslen(word));
-        switch_layout(uinput_fd);
+        bool layout_toggled = request_layout(target_is_russian ? 1 : 0, system_layout, uinput_fd);
+        if (layout_toggled) metrics_inc(METRIC_LAYOUT_TOGGLES);
         sync_xkb_state(xkb_state, *system_layout);
         wprintf(L"Inputting word: %ls\n", target_word);
         for (size_t i = 0; i < wcslen(target_word); i++) {
             send_char(uinput_fd, target_word[i], target_is_russian, display, system_layout, use_super_space);
         }
+        journal_record(word, target_word, !target_is_russian, layout_toggled);
+        metrics_inc(METRIC_CORRECTIONS);
+        metrics_observe(HIST_CORRECTION, metrics_now() - correction_start);
     } else {
         wprintf(L"No match in %ls dictionary\n", layout == 1 ? L"Russian" : L"English");
     }
+    return word_found;
 }
\ No newline at end of file
@@ -9,14 +9,25 @@
 #define DICT_FILE_ENG "english_dict.txt"
 #define DICT_FILE_RUS "russian_dict.txt"
 
+struct Morphology;
+struct FuzzyIndex;
+
 typedef struct {
     wchar_t **words;
     size_t count;
+    size_t max_len;
+    wchar_t *image;
+    struct Morphology *morph;
+    struct FuzzyIndex *fuzzy;
 } Dictionary;
 
 bool load_dictionary(const char *filename, Dictionary *dict);
 void free_dictionary(Dictionary *dict);
+bool attach_morphology(Dictionary *dict, const char *paradigm_file, const char *stem_file);
+bool attach_fuzzy_index(Dictionary *dict);
 bool is_in_dict(const wchar_t *word, Dictionary *dict);
-void process_word(wchar_t *word, Dictionary *eng_dict, Dictionary *rus_dict, int uinput_fd, bool use_super_space, int *system_layout, Display *display, struct xkb_state *xkb_state);
+const wchar_t *choose_correction(const wchar_t *word_norm, const wchar_t *converted_word, const wchar_t *converted_norm, int layout, Dictionary *eng_dict, Dictionary *rus_dict);
+// Returns true when the word was deleted together with the space after it and retyped.
+bool process_word(wchar_t *word, const wchar_t *word_norm, Dictionary *eng_dict, Dictionary *rus_dict, int uinput_fd, bool use_super_space, int *system_layout, Display *display, struct xkb_state *xkb_state);
 
 #endif
\ No newline at end of file
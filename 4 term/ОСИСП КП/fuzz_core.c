@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+#include <locale.h>
+#include <X11/Xlib.h>
+#include <xkbcommon/xkbcommon.h>
+#include "dictionary.h"
+#include "utils.h"
+#include "layout.h"
+#include "charclass.h"
+#include "normalize.h"
+#include "fuzzy.h"
+#include "metrics.h"
+
+#define FUZZ_DICT_FILE "/tmp/layout-switcher-fuzz-dict.txt"
+#define FUZZ_DICT_WORDS 20000
+#define FUZZ_MAX_WORD 64
+#define PROPERTY_ITERATIONS 20000
+#define THROUGHPUT_WORDS 1000000
+
+static const wchar_t fuzz_alphabet[] = L"qwertyuiop[]asdfghjkl;'zxcvbnm,./`QWERTYUIOP{}ASDFGHJKL:\"ZXCVBNM<>?~"
+                                       L"йцукенгшщзхъфывапролджэячсмитьбюёЙЦУКЕНГШЩЗХЪФЫВАПРОЛДЖЭЯЧСМИТЬБЮЁ"
+                                       L"0123456789-_@éàü ";
+
+static Dictionary dict;
+static wchar_t **reference;
+static size_t reference_count;
+
+#define CHECK(cond, ...) do { if (!(cond)) { fwprintf(stderr, __VA_ARGS__); abort(); } } while (0)
+
+static void random_word(wchar_t *word, size_t len, const wchar_t *alphabet, size_t alphabet_len) {
+    for (size_t i = 0; i < len; i++) word[i] = alphabet[rand() % alphabet_len];
+    word[len] = L'\0';
+}
+
+static void setup(void) {
+    if (reference) return;
+    setlocale(LC_ALL, "C.UTF-8");
+    srand(7);
+    FILE *file = fopen(FUZZ_DICT_FILE, "w, ccs=UTF-8");
+    CHECK(file, L"Cannot create %hs\n", FUZZ_DICT_FILE);
+    reference = malloc(FUZZ_DICT_WORDS * sizeof(wchar_t*));
+    const wchar_t *letters = L"абвгдежзийклмнопрстуфхцчшщъыьэюяёabcdefghijklmnopqrstuvwxyzАБВ";
+    for (size_t i = 0; i < FUZZ_DICT_WORDS; i++) {
+        wchar_t word[FUZZ_MAX_WORD + 1];
+        random_word(word, 2 + rand() % 8, letters, wcslen(letters));
+        fwprintf(file, L"%ls\n", word);
+        normalize_word(word);
+        reference[reference_count++] = wcsdup(word);
+    }
+    fclose(file);
+    CHECK(load_dictionary(FUZZ_DICT_FILE, &dict), L"Cannot load %hs\n", FUZZ_DICT_FILE);
+    CHECK(attach_fuzzy_index(&dict), L"Cannot build fuzzy index\n");
+}
+
+static bool linear_lookup(const wchar_t *word) {
+    for (size_t i = 0; i < reference_count; i++) {
+        if (wcscmp(reference[i], word) == 0) return true;
+    }
+    return false;
+}
+
+static void check_word(const wchar_t *word) {
+    size_t len = wcslen(word);
+    wchar_t converted[FUZZ_MAX_WORD + 1], back[FUZZ_MAX_WORD + 1], folded[FUZZ_MAX_WORD + 1];
+
+    bool eng_only = true;
+    for (size_t i = 0; i < len; i++) {
+        if (!wcschr(eng_chars, word[i])) eng_only = false;
+    }
+    if (eng_only) {
+        convert_layout(word, converted, folded, FUZZ_MAX_WORD + 1, true);
+        convert_layout(converted, back, NULL, FUZZ_MAX_WORD + 1, false);
+        CHECK(wcscmp(word, back) == 0, L"Round trip failed: %ls -> %ls -> %ls\n", word, converted, back);
+    }
+
+    ScriptCounts scalar, simd;
+    count_scripts_scalar(word, len, &scalar);
+    count_scripts(word, len, &simd);
+    CHECK(scalar.en == simd.en && scalar.ru == simd.ru && scalar.other == simd.other,
+          L"Script counts differ for %ls\n", word);
+
+    for (int system_layout = 0; system_layout < 2; system_layout++) {
+        int layout = detect_word_layout(word, system_layout);
+        CHECK(layout >= 0 && layout <= 2, L"Bad layout %d for %ls\n", layout, word);
+        CHECK(scalar.en + scalar.ru > 0 || layout == 0, L"Layout %d without letters: %ls\n", layout, word);
+        CHECK(layout != 1 || scalar.en * 2 >= scalar.en + scalar.ru, L"English without Latin majority: %ls\n", word);
+        CHECK(layout != 2 || scalar.ru * 2 >= scalar.en + scalar.ru, L"Russian without Cyrillic majority: %ls\n", word);
+    }
+
+    wchar_t norm[FUZZ_MAX_WORD + 1];
+    wcscpy(norm, word);
+    normalize_word(norm);
+    CHECK(is_in_dict(norm, &dict) == linear_lookup(norm), L"Lookup disagrees for %ls\n", norm);
+    const wchar_t *fuzzy = fuzzy_lookup(dict.fuzzy, dict.words, norm);
+    CHECK(!fuzzy || linear_lookup(fuzzy), L"Fuzzy result %ls not in dictionary\n", fuzzy);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    setup();
+    size_t alphabet_len = wcslen(fuzz_alphabet);
+    wchar_t word[FUZZ_MAX_WORD + 1];
+    size_t len = size < FUZZ_MAX_WORD ? size : FUZZ_MAX_WORD;
+    for (size_t i = 0; i < len; i++) word[i] = fuzz_alphabet[data[i] % alphabet_len];
+    word[len] = L'\0';
+    check_word(word);
+    return 0;
+}
+
+#ifndef FUZZING
+static double throughput(void) {
+    wchar_t word[FUZZ_MAX_WORD + 1], converted[FUZZ_MAX_WORD + 1], folded[FUZZ_MAX_WORD + 1];
+    const wchar_t *typed = L"qwertyuiopasdfghjklzxcvbnm";
+    size_t hits = 0;
+    double start = metrics_now();
+    for (size_t i = 0; i < THROUGHPUT_WORDS; i++) {
+        random_word(word, 3 + i % 7, typed, wcslen(typed));
+        ScriptCounts counts;
+        count_scripts(word, wcslen(word), &counts);
+        convert_layout(word, converted, folded, FUZZ_MAX_WORD + 1, true);
+        hits += is_in_dict(folded, &dict);
+    }
+    double elapsed = metrics_now() - start;
+    fwprintf(stderr, L"throughput: %.0f words/s (%zu hits)\n", THROUGHPUT_WORDS / elapsed, hits);
+    return THROUGHPUT_WORDS / elapsed;
+}
+
+int main(int argc, char **argv) {
+    setup();
+    freopen("/dev/null", "w", stdout);
+    size_t alphabet_len = wcslen(fuzz_alphabet);
+    for (size_t i = 0; i < PROPERTY_ITERATIONS; i++) {
+        wchar_t word[FUZZ_MAX_WORD + 1];
+        random_word(word, 1 + rand() % 16, fuzz_alphabet, alphabet_len);
+        check_word(word);
+    }
+    fwprintf(stderr, L"properties: %d random words OK\n", PROPERTY_ITERATIONS);
+
+    double rate = throughput();
+    if (argc >= 2) {
+        double baseline = atof(argv[1]);
+        double max_regression = argc >= 3 ? atof(argv[2]) : 0.1;
+        if (rate < baseline * (1.0 - max_regression)) {
+            fwprintf(stderr, L"FAIL: %.0f words/s is more than %.0f%% below baseline %.0f\n",
+                     rate, max_regression * 100, baseline);
+            return 1;
+        }
+    }
+    return 0;
+}
+#endif
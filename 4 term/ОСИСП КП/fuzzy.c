@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <string.h>
+#include "fuzzy.h"
+#include "metrics.h"
+
+static uint32_t hash_skip(const wchar_t *word, size_t len, size_t skip) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        if (i == skip) continue;
+        h = (h ^ (uint32_t)word[i]) * 16777619u;
+    }
+    return h ? h : 1;
+}
+
+static void index_insert(FuzzyIndex *index, uint32_t hash, int32_t word) {
+    size_t slot = hash & index->mask;
+    while (index->entries[slot].hash) {
+        if (index->entries[slot].hash == hash && index->entries[slot].word == word) return;
+        slot = (slot + 1) & index->mask;
+    }
+    index->entries[slot] = (FuzzyEntry){hash, word};
+    index->count++;
+}
+
+bool build_fuzzy_index(wchar_t **words, size_t count, FuzzyIndex *index) {
+    size_t variants = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t len = wcslen(words[i]);
+        if (len + 1 >= FUZZY_MIN_LEN) variants += len + 1;
+    }
+    size_t size = 1;
+    while (size < variants * 2) size <<= 1;
+    index->entries = calloc(size, sizeof(FuzzyEntry));
+    if (!index->entries) return false;
+    index->mask = size - 1;
+    index->count = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        size_t len = wcslen(words[i]);
+        if (len + 1 < FUZZY_MIN_LEN) continue;
+        index_insert(index, hash_skip(words[i], len, len), (int32_t)i);
+        for (size_t skip = 0; skip < len; skip++) {
+            index_insert(index, hash_skip(words[i], len, skip), (int32_t)i);
+        }
+    }
+    wprintf(L"Fuzzy index: %zu entries for %zu words\n", index->count, count);
+    return true;
+}
+
+void free_fuzzy_index(FuzzyIndex *index) {
+    free(index->entries);
+    index->entries = NULL;
+    index->mask = 0;
+    index->count = 0;
+}
+
+static bool within_one_edit(const wchar_t *a, size_t a_len, const wchar_t *b, size_t b_len) {
+    if (a_len > b_len + 1 || b_len > a_len + 1) return false;
+    size_t prefix = 0;
+    while (prefix < a_len && prefix < b_len && a[prefix] == b[prefix]) prefix++;
+    if (a_len == b_len) {
+        if (prefix == a_len) return true;
+        if (wcscmp(a + prefix + 1, b + prefix + 1) == 0) return true;
+        return prefix + 1 < a_len && a[prefix] == b[prefix + 1] && a[prefix + 1] == b[prefix] &&
+               wcscmp(a + prefix + 2, b + prefix + 2) == 0;
+    }
+    if (a_len > b_len) return wcscmp(a + prefix + 1, b + prefix) == 0;
+    return wcscmp(a + prefix, b + prefix + 1) == 0;
+}
+
+const wchar_t *fuzzy_lookup(const FuzzyIndex *index, wchar_t **words, const wchar_t *word) {
+    size_t len = wcslen(word);
+    if (!index || !index->entries || len < FUZZY_MIN_LEN) return NULL;
+
+    double deadline = metrics_now() + FUZZY_BUDGET_US / 1e6;
+    int probes = 0;
+    for (size_t skip = len + 1; skip-- > 0;) {
+        uint32_t hash = hash_skip(word, len, skip);
+        size_t slot = hash & index->mask;
+        while (index->entries[slot].hash) {
+            if (index->entries[slot].hash == hash) {
+                const wchar_t *candidate = words[index->entries[slot].word];
+                if (within_one_edit(word, len, candidate, wcslen(candidate))) return candidate;
+            }
+            slot = (slot + 1) & index->mask;
+            if (++probes % 64 == 0 && metrics_now() > deadline) {
+                wprintf(L"Fuzzy lookup budget exceeded for %ls\n", word);
+                return NULL;
+            }
+        }
+    }
+    return NULL;
+}
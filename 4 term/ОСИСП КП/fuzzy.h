@@ -0,0 +1,27 @@
+#ifndef FUZZY_H
+#define FUZZY_H
+
+#include <wchar.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define FUZZY_MIN_LEN 4
+#define FUZZY_BUDGET_US 500
+
+typedef struct {
+    uint32_t hash;
+    int32_t word;
+} FuzzyEntry;
+
+typedef struct FuzzyIndex {
+    FuzzyEntry *entries;
+    size_t mask;
+    size_t count;
+} FuzzyIndex;
+
+bool build_fuzzy_index(wchar_t **words, size_t count, FuzzyIndex *index);
+void free_fuzzy_index(FuzzyIndex *index);
+const wchar_t *fuzzy_lookup(const FuzzyIndex *index, wchar_t **words, const wchar_t *word);
+
+#endif
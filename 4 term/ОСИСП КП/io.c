@@ -5,6 +5,11 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/time.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
 #include <linux/input.h>
 #include <linux/uinput.h>
 #include "io.h"
@@ -25,38 +30,56 @@ void send_key(int fd, int keycode, int value) {
     write(fd, &ev, sizeof(ev));
 }
 
-void send_char(int uinput_fd, wchar_t target_char, bool is_russian, Display *display, int *system_layout, bool use_super_space) {
-    wprintf(L"send_char: target_char=%lc (U+%04X), is_russian=%d\n", target_char, (unsigned int)target_char, is_russian);
-
-    int key_code = 0;
+int char_to_key_code(wchar_t c, bool is_russian) {
+    wchar_t source_char = c;
     if (is_russian) {
-        const wchar_t *pos = wcschr(rus_chars, target_char);
-        if (!pos) {
-            wprintf(L"Cannot map char: %lc\n", target_char);
-            return;
+        const wchar_t *pos = wcschr(rus_chars, c);
+        if (!pos || (size_t)(pos - rus_chars) >= wcslen(eng_chars)) {
+            return 0;
         }
-        size_t index = pos - rus_chars;
-        if (index >= wcslen(eng_chars)) {
-            wprintf(L"Index out of range for char: %lc\n", target_char);
-            return;
-        }
-        wchar_t source_char = eng_chars[index];
-        for (size_t i = 0; i < sizeof(key_map) / sizeof(key_map[0]); i++) {
-            if (key_map[i].eng_char == source_char) {
-                key_code = key_map[i].key_code;
-                wprintf(L"Mapping Russian %lc to English %lc, key_code=%d\n", target_char, source_char, key_code);
-                break;
-            }
-        }
-    } else {
-        for (size_t i = 0; i < sizeof(key_map) / sizeof(key_map[0]); i++) {
-            if (key_map[i].eng_char == target_char) {
-                key_code = key_map[i].key_code;
-                wprintf(L"Using key_code=%d for English char %lc\n", key_code, target_char);
-                break;
-            }
+        source_char = eng_chars[pos - rus_chars];
+    }
+    for (size_t i = 0; i < sizeof(key_map) / sizeof(key_map[0]); i++) {
+        if (key_map[i].eng_char == source_char) {
+            return key_map[i].key_code;
         }
     }
+    return 0;
+}
+
+void batch_event(EventBatch *batch, int keycode, int value) {
+    if (batch->count + 2 > MAX_BATCH_EVENTS) {
+        wprintf(L"Event batch full, dropping key_code=%d\n", keycode);
+        return;
+    }
+    struct input_event *ev = &batch->events[batch->count++];
+    memset(ev, 0, sizeof(*ev));
+    ev->type = EV_KEY;
+    ev->code = keycode;
+    ev->value = value;
+    ev = &batch->events[batch->count++];
+    memset(ev, 0, sizeof(*ev));
+    ev->type = EV_SYN;
+    ev->code = SYN_REPORT;
+}
+
+void batch_key(EventBatch *batch, int keycode) {
+    batch_event(batch, keycode, 1);
+    batch_event(batch, keycode, 0);
+}
+
+void batch_flush(int fd, EventBatch *batch) {
+    if (batch->count == 0) return;
+    if (write(fd, batch->events, batch->count * sizeof(struct input_event)) < 0) {
+        perror("Failed to write event batch");
+    }
+    batch->count = 0;
+}
+
+void send_char(int uinput_fd, wchar_t target_char, bool is_russian, Display *display, int *system_layout, bool use_super_space) {
+    wprintf(L"send_char: target_char=%lc (U+%04X), is_russian=%d\n", target_char, (unsigned int)target_char, is_russian);
+
+    int key_code = char_to_key_code(target_char, is_russian);
     if (key_code == 0) {
         wprintf(L"No key code for char: %lc\n", target_char);
         return;
@@ -95,6 +118,58 @@ void switch_layout(int uinput_fd) {
     usleep(LAYOUT_SWITCH_DELAY);
 }
 
+static bool find_event_node(const char *sysname, char *node, size_t size) {
+    char sys_path[128];
+    snprintf(sys_path, sizeof(sys_path), "/sys/devices/virtual/input/%s", sysname);
+    DIR *dir = opendir(sys_path);
+    if (!dir) return false;
+    struct dirent *entry;
+    bool found = false;
+    while ((entry = readdir(dir))) {
+        if (strncmp(entry->d_name, "event", 5) == 0) {
+            int written = snprintf(node, size, "/dev/input/%s", entry->d_name);
+            found = written > 0 && (size_t)written < size;
+            break;
+        }
+    }
+    closedir(dir);
+    return found;
+}
+
+static void wait_uinput_ready(int uinput_fd) {
+    char sysname[64];
+    char node[sizeof("/dev/input/") + NAME_MAX];
+    if (ioctl(uinput_fd, UI_GET_SYSNAME(sizeof(sysname)), sysname) < 0 ||
+        !find_event_node(sysname, node, sizeof(node))) {
+        wprintf(L"Cannot resolve uinput event node, waiting %d ms\n", UINPUT_READY_TIMEOUT_MS);
+        usleep(UINPUT_READY_TIMEOUT_MS * 1000);
+        return;
+    }
+
+    int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0 || inotify_add_watch(inotify_fd, "/dev/input", IN_CREATE) < 0) {
+        if (inotify_fd >= 0) close(inotify_fd);
+        usleep(UINPUT_READY_TIMEOUT_MS * 1000);
+        return;
+    }
+
+    struct timeval start, now;
+    gettimeofday(&start, NULL);
+    int remaining = UINPUT_READY_TIMEOUT_MS;
+    while (access(node, F_OK) != 0 && remaining > 0) {
+        struct pollfd pfd = {inotify_fd, POLLIN, 0};
+        if (poll(&pfd, 1, remaining) < 0 && errno != EINTR) break;
+        char events[4096];
+        while (read(inotify_fd, events, sizeof(events)) > 0) {}
+        gettimeofday(&now, NULL);
+        remaining = UINPUT_READY_TIMEOUT_MS - (int)((now.tv_sec - start.tv_sec) * 1000 + (now.tv_usec - start.tv_usec) / 1000);
+    }
+    close(inotify_fd);
+    gettimeofday(&now, NULL);
+    wprintf(L"uinput device %hs ready after %ld ms\n", node,
+            (long)((now.tv_sec - start.tv_sec) * 1000 + (now.tv_usec - start.tv_usec) / 1000));
+}
+
 int setup_uinput_device(int *uinput_fd) {
     *uinput_fd = open(UINPUT_DEVICE, O_WRONLY | O_NONBLOCK);
     if (*uinput_fd < 0) {
@@ -129,6 +204,94 @@ int setup_uinput_device(int *uinput_fd) {
         close(*uinput_fd);
         return -1;
     }
-    sleep(1);
+    wait_uinput_ready(*uinput_fd);
     return 0;
-}
\ No newline at end of file
+}
+
+static CorrectionEntry journal[JOURNAL_SIZE];
+static int journal_count = 0;
+
+void journal_record(const wchar_t *original, const wchar_t *emitted, bool original_is_russian, bool layout_toggled) {
+    int delta = (int)wcslen(emitted) - (int)wcslen(original);
+    for (int i = 0; i < journal_count; i++) {
+        journal[i].tail += delta;
+    }
+    if (journal_count == JOURNAL_SIZE) {
+        memmove(journal, journal + 1, (JOURNAL_SIZE - 1) * sizeof(CorrectionEntry));
+        journal_count--;
+    }
+    CorrectionEntry *entry = &journal[journal_count++];
+    wcsncpy(entry->original, original, MAX_WORD_LEN - 1);
+    entry->original[MAX_WORD_LEN - 1] = L'\0';
+    wcsncpy(entry->emitted, emitted, MAX_WORD_LEN - 1);
+    entry->emitted[MAX_WORD_LEN - 1] = L'\0';
+    entry->original_is_russian = original_is_russian;
+    entry->layout_toggled = layout_toggled;
+    entry->tail = 0;
+}
+
+void journal_note_input(int delta) {
+    int keep = 0;
+    for (int i = 0; i < journal_count; i++) {
+        journal[i].tail += delta;
+        if (journal[i].tail < 0) {
+            journal_clear();
+            return;
+        }
+        if (journal[i].tail > JOURNAL_MAX_TAIL) {
+            keep = i + 1;
+        }
+    }
+    if (keep > 0) {
+        memmove(journal, journal + keep, (journal_count - keep) * sizeof(CorrectionEntry));
+        journal_count -= keep;
+    }
+}
+
+void journal_clear(void) {
+    journal_count = 0;
+}
+
+int journal_depth(void) {
+    return journal_count;
+}
+
+bool undo_last_correction(int uinput_fd, int *system_layout) {
+    if (journal_count == 0) {
+        wprintf(L"Nothing to undo\n");
+        return false;
+    }
+    CorrectionEntry *entry = &journal[--journal_count];
+    wprintf(L"Undoing correction: %ls -> %ls\n", entry->emitted, entry->original);
+    int delta = (int)wcslen(entry->original) - (int)wcslen(entry->emitted);
+    for (int i = 0; i < journal_count; i++) {
+        journal[i].tail += delta;
+    }
+
+    static EventBatch batch;
+    batch.count = 0;
+    for (int i = 0; i < entry->tail; i++) {
+        batch_key(&batch, LEFTARROW_KEY_CODE);
+    }
+    for (size_t i = 0; i < wcslen(entry->emitted); i++) {
+        batch_key(&batch, BACKSPACE_KEY_CODE);
+    }
+    batch_flush(uinput_fd, &batch);
+    if (entry->layout_toggled) {
+        request_layout(entry->original_is_russian ? 1 : 0, system_layout, uinput_fd);
+    }
+
+    for (size_t i = 0; i < wcslen(entry->original); i++) {
+        int key_code = char_to_key_code(entry->original[i], entry->original_is_russian);
+        if (key_code == 0) {
+            wprintf(L"No key code for char: %lc\n", entry->original[i]);
+            continue;
+        }
+        batch_key(&batch, key_code);
+    }
+    for (int i = 0; i < entry->tail; i++) {
+        batch_key(&batch, RIGHTARROW_KEY_CODE);
+    }
+    batch_flush(uinput_fd, &batch);
+    return true;
+}
@@ -16,6 +16,12 @@
 #define LEFTSHIFT_KEY_CODE 42
 #define SPACE_KEY_CODE 57
 #define LEFTALT_KEY_CODE 56
+#define RIGHTARROW_KEY_CODE 106
+#define MAX_WORD_LEN 256
+#define MAX_BATCH_EVENTS 4096
+#define JOURNAL_SIZE 16
+#define JOURNAL_MAX_TAIL 64
+#define UINPUT_READY_TIMEOUT_MS 1000
 
 struct key_map_entry {
     int key_code;
@@ -36,10 +42,32 @@ static const struct key_map_entry key_map[] = {
         {KEY_SLASH, L'/'}
 };
 
+typedef struct {
+    struct input_event events[MAX_BATCH_EVENTS];
+    size_t count;
+} EventBatch;
+
+typedef struct {
+    wchar_t original[MAX_WORD_LEN];
+    wchar_t emitted[MAX_WORD_LEN];
+    bool original_is_russian;
+    bool layout_toggled;
+    int tail;
+} CorrectionEntry;
+
 void send_key(int fd, int keycode, int value);
+void batch_event(EventBatch *batch, int keycode, int value);
+void batch_key(EventBatch *batch, int keycode);
+void batch_flush(int fd, EventBatch *batch);
+int char_to_key_code(wchar_t c, bool is_russian);
 void send_char(int uinput_fd, wchar_t target_char, bool is_russian, Display *display, int *system_layout, bool use_super_space);
 void select_and_delete_word(int uinput_fd, int len);
 void switch_layout(int uinput_fd);
 int setup_uinput_device(int *uinput_fd);
+void journal_record(const wchar_t *original, const wchar_t *emitted, bool original_is_russian, bool layout_toggled);
+void journal_note_input(int delta);
+void journal_clear(void);
+int journal_depth(void);
+bool undo_last_correction(int uinput_fd, int *system_layout);
 
 #endif
\ No newline at end of file
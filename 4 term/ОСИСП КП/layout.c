@@ -3,9 +3,14 @@
 #include <wchar.h>
 #include <X11/Xlib.h>
 #include <X11/XKBlib.h>
+#include <X11/Xutil.h>
 #include <xkbcommon/xkbcommon.h>
 #include "layout.h"
 #include "utils.h"
+#include "metrics.h"
+#include "charclass.h"
+#include "backend.h"
+#include "io.h"
 
 int detect_word_layout(const wchar_t *text, int system_layout) {
     if (text == NULL || *text == L'\0') {
@@ -13,20 +18,11 @@ int detect_word_layout(const wchar_t *text, int system_layout) {
         return 0;
     }
 
-    int en_count = 0;
-    int ru_count = 0;
-    int total_chars = 0;
-
-    for (size_t i = 0; text[i]; i++) {
-        wprintf(L"Processing char: %lc (U+%04X)\n", text[i], (unsigned int)text[i]);
-        if ((text[i] >= L'A' && text[i] <= L'Z') || (text[i] >= L'a' && text[i] <= L'z')) {
-            total_chars++;
-            en_count++;
-        } else if (text[i] >= 0x0410 && text[i] <= 0x044F) {
-            total_chars++;
-            ru_count++;
-        }
-    }
+    ScriptCounts counts;
+    count_scripts(text, wcslen(text), &counts);
+    int en_count = (int)counts.en;
+    int ru_count = (int)counts.ru;
+    int total_chars = en_count + ru_count;
 
     if (total_chars == 0) {
         wprintf(L"No valid characters in text\n");
@@ -62,6 +58,7 @@ int get_x11_layout_group(Display *display) {
         return -1;
     }
     XkbStateRec xkb_state;
+    metrics_inc(METRIC_X11_CALLS);
     if (XkbGetState(display, XkbUseCoreKbd, &xkb_state) != Success) {
         wprintf(L"Failed to get X11 keyboard state\n");
         return -1;
@@ -78,10 +75,36 @@ void sync_xkb_state(struct xkb_state *xkb_state, int group) {
     }
 }
 
+static Backend *active_backend = NULL;
+
+void layout_set_backend(Backend *backend) {
+    active_backend = backend;
+    if (backend) wprintf(L"Layout backend: %hs\n", backend->name);
+}
+
+bool request_layout(int group, int *system_layout, int uinput_fd) {
+    bool toggled = *system_layout != group;
+    if (active_backend && active_backend->set_layout && active_backend->set_layout(active_backend, group)) {
+        *system_layout = group;
+        return toggled;
+    }
+    if (toggled) {
+        switch_layout(uinput_fd);
+        *system_layout = group;
+        if (active_backend && active_backend->layout >= 0) active_backend->layout = group;
+    }
+    return toggled;
+}
+
 int update_system_layout(Display *display, int *system_layout) {
+    if (active_backend && active_backend->layout >= 0) {
+        *system_layout = active_backend->layout;
+        return *system_layout;
+    }
     int new_layout = -1;
     if (display) {
         XkbStateRec xkb_state;
+        metrics_inc(METRIC_X11_CALLS);
         if (XkbGetState(display, XkbUseCoreKbd, &xkb_state) == Success) {
             new_layout = xkb_state.group;
             wprintf(L"X11 layout group: %d (%ls)\n", new_layout, new_layout == 0 ? L"us" : L"ru");
@@ -99,4 +122,28 @@ int update_system_layout(Display *display, int *system_layout) {
     }
     *system_layout = new_layout;
     return new_layout;
-}
\ No newline at end of file
+}
+
+bool get_active_app(Display *display, char *app, size_t size) {
+    if (!display) return false;
+    Window window;
+    int revert_to;
+    metrics_inc(METRIC_X11_CALLS);
+    XGetInputFocus(display, &window, &revert_to);
+    while (window != None && window != PointerRoot) {
+        XClassHint hint;
+        if (XGetClassHint(display, window, &hint)) {
+            snprintf(app, size, "%s", hint.res_class ? hint.res_class : "");
+            if (hint.res_name) XFree(hint.res_name);
+            if (hint.res_class) XFree(hint.res_class);
+            return true;
+        }
+        Window root, parent, *children = NULL;
+        unsigned int child_count;
+        if (!XQueryTree(display, window, &root, &parent, &children, &child_count)) break;
+        if (children) XFree(children);
+        if (parent == root) break;
+        window = parent;
+    }
+    return false;
+}
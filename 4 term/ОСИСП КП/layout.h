@@ -2,12 +2,19 @@
 #define LAYOUT_H
 
 #include <wchar.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <X11/Xlib.h>
 #include <xkbcommon/xkbcommon.h>
 
+struct Backend;
+
 int detect_word_layout(const wchar_t *text, int system_layout);
 int get_x11_layout_group(Display *display);
 void sync_xkb_state(struct xkb_state *xkb_state, int group);
 int update_system_layout(Display *display, int *system_layout);
+bool get_active_app(Display *display, char *app, size_t size);
+void layout_set_backend(struct Backend *backend);
+bool request_layout(int group, int *system_layout, int uinput_fd);
 
 #endif
\ No newline at end of file
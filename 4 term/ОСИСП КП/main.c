@@ -11,10 +11,16 @@
 #include <xkbcommon/xkbcommon.h>
 #include <locale.h>
 #include <wctype.h>
+#include <signal.h>
 #include "utils.h"
 #include "dictionary.h"
 #include "io.h"
 #include "layout.h"
+#include "metrics.h"
+#include "control.h"
+#include "morphology.h"
+#include "normalize.h"
+#include "backend.h"
 
 #define INPUT_DEVICE "/dev/input/event3"
 #define ESC_KEY_CODE 1
@@ -23,12 +29,33 @@
 #define LEFTSHIFT_KEY_CODE 42
 #define LEFTALT_KEY_CODE 56
 #define LEFTMETA_KEY_CODE 125
+#define UNDO_KEY_CODE 119
 #define MAX_WORD_LEN 256
+#define TOKEN_TRAILING_PUNCT L".,!?;:"
 
-int main() {
+static volatile sig_atomic_t running = 1;
+
+static int token_limit(const Dictionary *eng_dict, const Dictionary *rus_dict) {
+    size_t limit = (eng_dict->max_len > rus_dict->max_len ? eng_dict->max_len : rus_dict->max_len) + 1;
+    return limit < MAX_WORD_LEN - 1 ? (int)limit : MAX_WORD_LEN - 1;
+}
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+int main(int argc, char **argv) {
     setlocale(LC_ALL, "");
 
+    bool daemon_mode = argc > 1 && strcmp(argv[1], "--daemon") == 0;
+    struct sigaction sa = {0};
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
     bool use_super_space = false;
+    metrics_inc(METRIC_GSETTINGS_CALLS);
     FILE *gsettings_pipe = popen("gsettings get org.gnome.desktop.input-sources xkb-options", "r");
     if (gsettings_pipe) {
         char buffer[256];
@@ -80,7 +107,15 @@ int main() {
         return 1;
     }
 
-    int system_layout = get_x11_layout_group(display);
+    Backend backend = {0};
+    if (backend_open_x11(&backend, display) || backend_open_wayland(&backend) || backend_open_gsettings(&backend)) {
+        layout_set_backend(&backend);
+    } else {
+        backend.fd = -1;
+        backend.layout = -1;
+    }
+
+    int system_layout = backend.layout >= 0 ? backend.layout : get_x11_layout_group(display);
     if (system_layout < 0) {
         system_layout = get_gsettings_layout_group();
     }
@@ -102,6 +137,9 @@ int main() {
         free_dictionary(&rus_dict);
         return 1;
     }
+    attach_morphology(&rus_dict, MORPH_FILE_PARADIGMS, MORPH_FILE_STEMS);
+    attach_fuzzy_index(&eng_dict);
+    attach_fuzzy_index(&rus_dict);
 
     int input_fd = open(INPUT_DEVICE, O_RDONLY | O_NONBLOCK);
     if (input_fd < 0) {
@@ -127,31 +165,92 @@ int main() {
         return 1;
     }
 
-    wprintf(L"Слушаю ввод... Нажмите ESC для выхода.\n");
+    char metrics_path[108];
+    int metrics_fd = metrics_listen(metrics_path, sizeof(metrics_path));
+    ControlState control = {0};
+    char control_path[108];
+    int control_fd = control_listen(control_path, sizeof(control_path));
+
+    if (daemon_mode) {
+        wprintf(L"Слушаю ввод в режиме демона.\n");
+    } else {
+        wprintf(L"Слушаю ввод... Нажмите ESC для выхода.\n");
+    }
 
     struct input_event ev;
     wchar_t word[MAX_WORD_LEN] = {0};
+    wchar_t word_norm[MAX_WORD_LEN] = {0};
     int word_len = 0;
+    int max_token_len = token_limit(&eng_dict, &rus_dict);
+    int trailing_punct = 0;
+    bool token_skipped = false;
     bool shift_pressed = false;
     bool alt_pressed = false;
     bool super_pressed = false;
     fd_set read_fds;
     struct timeval tv;
 
-    while (1) {
+    while (running) {
         FD_ZERO(&read_fds);
         FD_SET(input_fd, &read_fds);
+        if (metrics_fd >= 0) FD_SET(metrics_fd, &read_fds);
+        if (control_fd >= 0) FD_SET(control_fd, &read_fds);
+        if (backend.fd >= 0) FD_SET(backend.fd, &read_fds);
         tv.tv_sec = 0;
         tv.tv_usec = 10000;
 
-        int ret = select(input_fd + 1, &read_fds, NULL, NULL, &tv);
+        int max_fd = input_fd > metrics_fd ? input_fd : metrics_fd;
+        if (control_fd > max_fd) max_fd = control_fd;
+        if (backend.fd > max_fd) max_fd = backend.fd;
+        max_fd = metrics_watch(&read_fds, max_fd);
+        max_fd = control_watch(&read_fds, max_fd);
+        int ret = select(max_fd + 1, &read_fds, NULL, NULL, &tv);
         if (ret < 0) {
+            if (!running) break;
             perror("select failed");
             break;
         }
+        if (backend.dispatch && (FD_ISSET(backend.fd, &read_fds) || backend.display)) {
+            backend.dispatch(&backend);
+        }
+        if (metrics_fd >= 0 && FD_ISSET(metrics_fd, &read_fds)) {
+            metrics_accept(metrics_fd);
+        }
+        metrics_serve(&read_fds);
+        if (control_fd >= 0 && FD_ISSET(control_fd, &read_fds)) {
+            control_accept(control_fd);
+        }
+        if (control_serve(&read_fds, &control)) {
+            if (control.reload_requested) {
+                control.reload_requested = false;
+                Dictionary new_eng = {0}, new_rus = {0};
+                if (load_dictionary(DICT_FILE_ENG, &new_eng) && load_dictionary(DICT_FILE_RUS, &new_rus)) {
+                    attach_morphology(&new_rus, MORPH_FILE_PARADIGMS, MORPH_FILE_STEMS);
+                    attach_fuzzy_index(&new_eng);
+                    attach_fuzzy_index(&new_rus);
+                    free_dictionary(&eng_dict);
+                    free_dictionary(&rus_dict);
+                    eng_dict = new_eng;
+                    rus_dict = new_rus;
+                    max_token_len = token_limit(&eng_dict, &rus_dict);
+                    wprintf(L"Словари перезагружены\n");
+                } else {
+                    free_dictionary(&new_eng);
+                    free_dictionary(&new_rus);
+                }
+            }
+            if (control.paused) {
+                journal_clear();
+                word_len = 0;
+                trailing_punct = 0;
+                token_skipped = false;
+                memset(word, 0, sizeof(word));
+            }
+        }
         if (ret == 0 || !FD_ISSET(input_fd, &read_fds)) continue;
 
         if (read(input_fd, &ev, sizeof(ev)) != sizeof(ev)) continue;
+        metrics_inc(METRIC_EVENTS);
 
         if (ev.type == EV_KEY && ev.value == 1) {
             if (ev.code == LEFTSHIFT_KEY_CODE) {
@@ -160,28 +259,43 @@ int main() {
                 alt_pressed = true;
             } else if (ev.code == LEFTMETA_KEY_CODE) {
                 super_pressed = true;
-            } else if (ev.code == ESC_KEY_CODE) {
+            } else if (ev.code == ESC_KEY_CODE && !daemon_mode) {
                 wprintf(L"ESC нажат. Выход.\n");
                 break;
+            } else if (ev.code == UNDO_KEY_CODE) {
+                if (undo_last_correction(uinput_fd, &system_layout)) {
+                    update_system_layout(display, &system_layout);
+                    sync_xkb_state(xkb_state, system_layout);
+                }
             } else if (ev.code == SPACE_KEY_CODE) {
-                if (word_len > 0) {
+                bool corrected = false;
+                if (word_len > 0 && !token_skipped && trailing_punct == 0 && !control.paused && !control_app_disabled(&control, display)) {
                     word[word_len] = L'\0';
-                    process_word(word, &eng_dict, &rus_dict, uinput_fd, use_super_space, &system_layout, display, xkb_state);
-                    word_len = 0;
-                    memset(word, 0, sizeof(word));
+                    word_norm[word_len] = L'\0';
+                    corrected = process_word(word, word_norm, &eng_dict, &rus_dict, uinput_fd, use_super_space, &system_layout, display, xkb_state);
                 }
-                send_key(uinput_fd, SPACE_KEY_CODE, 1);
-                send_key(uinput_fd, SPACE_KEY_CODE, 0);
+                word_len = 0;
+                trailing_punct = 0;
+                token_skipped = false;
+                memset(word, 0, sizeof(word));
+                // The keyboard is not grabbed, so the app already has the typed space;
+                // it only needs replacing when the correction deleted it with the word.
+                if (corrected) {
+                    send_key(uinput_fd, SPACE_KEY_CODE, 1);
+                    send_key(uinput_fd, SPACE_KEY_CODE, 0);
+                }
+                journal_note_input(1);
                 wprintf(L"Space pressed, processed word\n");
             } else if (ev.code == BACKSPACE_KEY_CODE) {
-                if (word_len > 0) {
+                journal_note_input(-1);
+                if (trailing_punct > 0) {
+                    trailing_punct--;
+                } else if (word_len > 0 && !token_skipped) {
                     word[--word_len] = L'\0';
+                    word_norm[word_len] = L'\0';
                     wprintf(L"Backspace pressed, removed last char, word_len: %d\n", word_len);
                 }
-            } else {
-                update_system_layout(display, &system_layout);
-                wprintf(L"System layout before adding char: %d (%ls)\n", system_layout, system_layout == 0 ? L"us" : L"ru");
-
+            } else if (!control.paused) {
                 wchar_t c = L'\0';
                 bool found = false;
                 for (size_t i = 0; i < sizeof(key_map) / sizeof(key_map[0]); i++) {
@@ -191,17 +305,30 @@ int main() {
                         break;
                     }
                 }
-                if (found && word_len < MAX_WORD_LEN - 1) {
+                if (found) {
+                    journal_note_input(1);
+                } else {
+                    journal_clear();
+                }
+                if (found && !token_skipped) {
+                    update_system_layout(display, &system_layout);
+                    wprintf(L"System layout before adding char: %d (%ls)\n", system_layout, system_layout == 0 ? L"us" : L"ru");
                     if (system_layout == 1) {
                         const wchar_t *pos = wcschr(eng_chars, c);
                         if (pos) {
                             c = rus_chars[pos - eng_chars];
                         }
                     }
-                    if (iswalpha(c)) {
+                    if (iswalpha(c) && trailing_punct == 0 && word_len < max_token_len) {
+                        word_norm[word_len] = normalize_char(c);
                         word[word_len++] = c;
                         wprintf(L"Added char: %lc (U+%04X), word_len: %d, system_layout: %d (%ls)\n",
                                 c, (unsigned int)c, word_len, system_layout, system_layout == 0 ? L"us" : L"ru");
+                    } else if (!iswalpha(c) && wcschr(TOKEN_TRAILING_PUNCT, c)) {
+                        trailing_punct++;
+                    } else {
+                        token_skipped = true;
+                        wprintf(L"Token is too long or looks like a URL/path/code, not tracking\n");
                     }
                 }
             }
@@ -222,6 +349,10 @@ int main() {
         }
     }
 
+    layout_set_backend(NULL);
+    backend_close(&backend);
+    control_close(control_fd, control_path);
+    metrics_close(metrics_fd, metrics_path);
     ioctl(uinput_fd, UI_DEV_DESTROY);
     close(uinput_fd);
     close(input_fd);
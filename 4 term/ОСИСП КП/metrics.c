@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <wchar.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "metrics.h"
+#include "io.h"
+
+static const char *counter_names[METRIC_COUNTERS] = {
+        "switcher_words_total",
+        "switcher_corrections_total",
+        "switcher_input_events_total",
+        "switcher_x11_calls_total",
+        "switcher_gsettings_calls_total",
+        "switcher_layout_toggles_total"
+};
+
+static const char *histogram_names[METRIC_HISTOGRAMS] = {
+        "switcher_dict_lookup_seconds",
+        "switcher_correction_seconds"
+};
+
+static const double bucket_bounds[METRICS_BUCKETS] = {
+        0.00001, 0.0001, 0.001, 0.01, 0.1, 0.5, 1.0, 5.0
+};
+
+typedef struct {
+    unsigned long buckets[METRICS_BUCKETS];
+    unsigned long count;
+    double sum;
+} Histogram;
+
+typedef struct {
+    bool open;
+    bool answered;
+    int fd;
+    double deadline;
+    size_t len;
+    char request[METRICS_REQUEST_SIZE];
+} MetricsClient;
+
+static unsigned long counters[METRIC_COUNTERS];
+static Histogram histograms[METRIC_HISTOGRAMS];
+static MetricsClient clients[METRICS_MAX_CLIENTS];
+
+double metrics_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void metrics_inc(MetricCounter counter) {
+    counters[counter]++;
+}
+
+void metrics_observe(MetricHistogram histogram, double seconds) {
+    Histogram *h = &histograms[histogram];
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        if (seconds <= bucket_bounds[i]) {
+            h->buckets[i]++;
+            break;
+        }
+    }
+    h->count++;
+    h->sum += seconds;
+}
+
+int metrics_listen(char *path, size_t path_size) {
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    snprintf(path, path_size, "%s/%s", runtime_dir ? runtime_dir : "/tmp", METRICS_SOCKET_NAME);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Failed to create metrics socket");
+        return -1;
+    }
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+        perror("Failed to bind metrics socket");
+        close(fd);
+        return -1;
+    }
+    wprintf(L"Metrics available on %hs\n", path);
+    return fd;
+}
+
+typedef struct {
+    char *data;
+    size_t size;
+    size_t len;
+    bool full;
+} MetricsBuffer;
+
+// Appends one entry; an entry that does not fit is dropped whole, as is everything after it.
+static void metrics_printf(MetricsBuffer *buffer, const char *format, ...) {
+    if (buffer->full) return;
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buffer->data + buffer->len, buffer->size - buffer->len, format, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= buffer->size - buffer->len) {
+        buffer->data[buffer->len] = '\0';
+        buffer->full = true;
+        wprintf(L"Metrics body truncated at %zu bytes\n", buffer->len);
+        return;
+    }
+    buffer->len += n;
+}
+
+size_t metrics_format(char *body, size_t size) {
+    if (size == 0) return 0;
+    MetricsBuffer buffer = {body, size, 0, false};
+    for (int i = 0; i < METRIC_COUNTERS; i++) {
+        metrics_printf(&buffer, "# TYPE %s counter\n%s %lu\n",
+                       counter_names[i], counter_names[i], counters[i]);
+    }
+    metrics_printf(&buffer, "# TYPE switcher_journal_depth gauge\nswitcher_journal_depth %d\n",
+                   journal_depth());
+    for (int i = 0; i < METRIC_HISTOGRAMS; i++) {
+        const char *name = histogram_names[i];
+        unsigned long cumulative = 0;
+        metrics_printf(&buffer, "# TYPE %s histogram\n", name);
+        for (int b = 0; b < METRICS_BUCKETS; b++) {
+            cumulative += histograms[i].buckets[b];
+            metrics_printf(&buffer, "%s_bucket{le=\"%g\"} %lu\n",
+                           name, bucket_bounds[b], cumulative);
+        }
+        metrics_printf(&buffer, "%s_bucket{le=\"+Inf\"} %lu\n%s_sum %.9f\n%s_count %lu\n",
+                       name, histograms[i].count, name, histograms[i].sum, name, histograms[i].count);
+    }
+    return buffer.len;
+}
+
+void metrics_accept(int listen_fd) {
+    int fd;
+    while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+        MetricsClient *client = NULL;
+        for (int i = 0; i < METRICS_MAX_CLIENTS && !client; i++) {
+            if (!clients[i].open) client = &clients[i];
+        }
+        if (!client || fcntl(fd, F_SETFL, O_NONBLOCK) < 0 || fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+            wprintf(L"Dropping metrics client\n");
+            close(fd);
+            continue;
+        }
+        client->open = true;
+        client->answered = false;
+        client->fd = fd;
+        client->deadline = metrics_now() + METRICS_CLIENT_TIMEOUT;
+        client->len = 0;
+    }
+}
+
+int metrics_watch(fd_set *read_fds, int max_fd) {
+    for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+        if (!clients[i].open) continue;
+        FD_SET(clients[i].fd, read_fds);
+        if (clients[i].fd > max_fd) max_fd = clients[i].fd;
+    }
+    return max_fd;
+}
+
+static void client_close(MetricsClient *client) {
+    close(client->fd);
+    client->open = false;
+}
+
+// The whole response goes out in one write: it is far smaller than the socket buffer.
+static void client_respond(MetricsClient *client) {
+    static char response[8192 + 128];
+    char body[8192];
+    size_t len = metrics_format(body, sizeof(body));
+    int header_len = snprintf(response, sizeof(response),
+                              "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n", len);
+    memcpy(response + header_len, body, len);
+    client->answered = true;
+    if (write(client->fd, response, header_len + len) != (ssize_t)(header_len + len)) {
+        perror("Failed to write metrics");
+        client_close(client);
+        return;
+    }
+    shutdown(client->fd, SHUT_WR);
+}
+
+// The request is read up to the blank line before answering, and whatever the client
+// sends afterwards is drained until it closes: closing with unread input would reset
+// the connection and the client could lose the response.
+void metrics_serve(const fd_set *read_fds) {
+    double now = metrics_now();
+    for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+        MetricsClient *client = &clients[i];
+        if (!client->open) continue;
+        if (FD_ISSET(client->fd, read_fds)) {
+            for (;;) {
+                char scratch[512];
+                bool keep = !client->answered && client->len < sizeof(client->request) - 1;
+                char *dst = keep ? client->request + client->len : scratch;
+                size_t room = keep ? sizeof(client->request) - 1 - client->len : sizeof(scratch);
+                ssize_t n = read(client->fd, dst, room);
+                if (n > 0) {
+                    if (keep) {
+                        client->len += n;
+                        client->request[client->len] = '\0';
+                    }
+                    continue;
+                }
+                if (n == 0) {
+                    if (!client->answered) client_respond(client);
+                    if (client->open) client_close(client);
+                } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    client_close(client);
+                }
+                break;
+            }
+            if (client->open && !client->answered &&
+                (strstr(client->request, "\r\n\r\n") || client->len == sizeof(client->request) - 1)) {
+                client_respond(client);
+            }
+        }
+        if (client->open && now > client->deadline) {
+            client_close(client);
+        }
+    }
+}
+
+void metrics_close(int listen_fd, const char *path) {
+    for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+        if (clients[i].open) client_close(&clients[i]);
+    }
+    if (listen_fd < 0) return;
+    close(listen_fd);
+    unlink(path);
+}
@@ -0,0 +1,39 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <sys/select.h>
+
+#define METRICS_SOCKET_NAME "layout-switcher-metrics.sock"
+#define METRICS_BUCKETS 8
+#define METRICS_MAX_CLIENTS 4
+#define METRICS_REQUEST_SIZE 2048
+#define METRICS_CLIENT_TIMEOUT 1.0
+
+typedef enum {
+    METRIC_WORDS,
+    METRIC_CORRECTIONS,
+    METRIC_EVENTS,
+    METRIC_X11_CALLS,
+    METRIC_GSETTINGS_CALLS,
+    METRIC_LAYOUT_TOGGLES,
+    METRIC_COUNTERS
+} MetricCounter;
+
+typedef enum {
+    HIST_DICT_LOOKUP,
+    HIST_CORRECTION,
+    METRIC_HISTOGRAMS
+} MetricHistogram;
+
+double metrics_now(void);
+void metrics_inc(MetricCounter counter);
+void metrics_observe(MetricHistogram histogram, double seconds);
+size_t metrics_format(char *body, size_t size);
+int metrics_listen(char *path, size_t path_size);
+void metrics_accept(int listen_fd);
+int metrics_watch(fd_set *read_fds, int max_fd);
+void metrics_serve(const fd_set *read_fds);
+void metrics_close(int listen_fd, const char *path);
+
+#endif
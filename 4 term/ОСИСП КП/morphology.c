@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <string.h>
+#include <stdint.h>
+#include "morphology.h"
+#include "normalize.h"
+
+typedef struct {
+    MorphEdge *edges;
+    int count;
+    int cap;
+} TrieNode;
+
+typedef struct {
+    TrieNode *nodes;
+    int count;
+    int cap;
+} Trie;
+
+static int trie_new_node(Trie *trie) {
+    if (trie->count == trie->cap) {
+        int cap = trie->cap ? trie->cap * 2 : 1024;
+        TrieNode *nodes = realloc(trie->nodes, cap * sizeof(TrieNode));
+        if (!nodes) return -1;
+        trie->nodes = nodes;
+        trie->cap = cap;
+    }
+    trie->nodes[trie->count] = (TrieNode){0};
+    return trie->count++;
+}
+
+static int trie_child(Trie *trie, int node, wchar_t label) {
+    TrieNode *n = &trie->nodes[node];
+    int pos = 0;
+    while (pos < n->count && n->edges[pos].label < label) pos++;
+    if (pos < n->count && n->edges[pos].label == label) return n->edges[pos].target;
+
+    int child = trie_new_node(trie);
+    if (child < 0) return -1;
+    n = &trie->nodes[node];
+    if (n->count == n->cap) {
+        int cap = n->cap ? n->cap * 2 : 2;
+        MorphEdge *edges = realloc(n->edges, cap * sizeof(MorphEdge));
+        if (!edges) return -1;
+        n->edges = edges;
+        n->cap = cap;
+    }
+    memmove(&n->edges[pos + 1], &n->edges[pos], (n->count - pos) * sizeof(MorphEdge));
+    n->edges[pos] = (MorphEdge){label, child};
+    n->count++;
+    return child;
+}
+
+static bool trie_insert(Trie *trie, const wchar_t *stem, int paradigm) {
+    int node = 0;
+    for (size_t i = 0; stem[i]; i++) {
+        node = trie_child(trie, node, stem[i]);
+        if (node < 0) return false;
+    }
+    return trie_child(trie, node, (wchar_t)(MORPH_PARADIGM_BASE + paradigm)) >= 0;
+}
+
+static uint64_t node_hash(const TrieNode *n) {
+    uint64_t h = 1469598103934665603ULL;
+    for (int i = 0; i < n->count; i++) {
+        h = (h ^ (uint32_t)n->edges[i].label) * 1099511628211ULL;
+        h = (h ^ (uint32_t)n->edges[i].target) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static bool node_equal(const TrieNode *a, const TrieNode *b) {
+    return a->count == b->count && memcmp(a->edges, b->edges, a->count * sizeof(MorphEdge)) == 0;
+}
+
+/* Bottom-up hash-consing: nodes with identical (label, canonical child) edge
+   lists have the same right language, so the trie collapses into a DAFSA. */
+static int minimize_node(Trie *trie, int node, int *canon, int *registry, size_t registry_mask) {
+    TrieNode *n = &trie->nodes[node];
+    for (int i = 0; i < n->count; i++) {
+        int child = n->edges[i].target;
+        if (canon[child] < 0) minimize_node(trie, child, canon, registry, registry_mask);
+        n->edges[i].target = canon[child];
+    }
+    size_t slot = node_hash(n) & registry_mask;
+    while (registry[slot] >= 0) {
+        if (node_equal(&trie->nodes[registry[slot]], n)) {
+            canon[node] = registry[slot];
+            return canon[node];
+        }
+        slot = (slot + 1) & registry_mask;
+    }
+    registry[slot] = node;
+    canon[node] = node;
+    return node;
+}
+
+static bool compile_dafsa(Trie *trie, Morphology *morph) {
+    size_t registry_size = 1;
+    while (registry_size < (size_t)trie->count * 2) registry_size <<= 1;
+    int *canon = malloc(trie->count * sizeof(int));
+    int *registry = malloc(registry_size * sizeof(int));
+    int *renumber = malloc(trie->count * sizeof(int));
+    if (!canon || !registry || !renumber) {
+        free(canon);
+        free(registry);
+        free(renumber);
+        return false;
+    }
+    memset(canon, -1, trie->count * sizeof(int));
+    memset(registry, -1, registry_size * sizeof(int));
+    minimize_node(trie, 0, canon, registry, registry_size - 1);
+
+    int node_count = 0;
+    size_t edge_count = 0;
+    for (int i = 0; i < trie->count; i++) {
+        renumber[i] = -1;
+        if (canon[i] == i) {
+            renumber[i] = node_count++;
+            edge_count += trie->nodes[i].count;
+        }
+    }
+
+    morph->node_first = malloc((node_count + 1) * sizeof(int));
+    morph->edges = malloc((edge_count ? edge_count : 1) * sizeof(MorphEdge));
+    if (!morph->node_first || !morph->edges) {
+        free(canon);
+        free(registry);
+        free(renumber);
+        return false;
+    }
+    size_t e = 0;
+    for (int i = 0; i < trie->count; i++) {
+        if (renumber[i] < 0) continue;
+        morph->node_first[renumber[i]] = (int)e;
+        for (int j = 0; j < trie->nodes[i].count; j++) {
+            morph->edges[e].label = trie->nodes[i].edges[j].label;
+            morph->edges[e].target = renumber[trie->nodes[i].edges[j].target];
+            e++;
+        }
+    }
+    morph->node_first[node_count] = (int)e;
+    morph->node_count = node_count;
+    morph->root = renumber[canon[0]];
+    morph->edge_count = edge_count;
+
+    free(canon);
+    free(registry);
+    free(renumber);
+    return true;
+}
+
+// Consumes the rest of a line that did not fit the buffer; false if the buffer held the whole last line.
+static bool skip_line_rest(FILE *file) {
+    wint_t c = fgetwc(file);
+    if (c == WEOF) return false;
+    while (c != WEOF && c != L'\n') c = fgetwc(file);
+    return true;
+}
+
+static bool load_paradigms(const char *filename, Morphology *morph) {
+    FILE *file = fopen(filename, "r, ccs=UTF-8");
+    if (!file) return false;
+    int cap = 0;
+    wchar_t line[MORPH_MAX_LINE];
+    while (fgetws(line, sizeof(line) / sizeof(line[0]), file)) {
+        if (morph->paradigm_count == cap) {
+            cap = cap ? cap * 2 : 64;
+            Paradigm *paradigms = realloc(morph->paradigms, cap * sizeof(Paradigm));
+            if (!paradigms) {
+                fclose(file);
+                return false;
+            }
+            morph->paradigms = paradigms;
+        }
+        Paradigm *p = &morph->paradigms[morph->paradigm_count++];
+        p->endings = NULL;
+        p->count = 0;
+        p->max_ending = 0;
+        int endings_cap = 0;
+        size_t length = wcslen(line);
+        if (length == MORPH_MAX_LINE - 1 && line[length - 1] != L'\n' && skip_line_rest(file)) {
+            // Paradigm numbers are line numbers, so an over-long line stays as an empty paradigm.
+            wprintf(L"Парадигма %d длиннее %d символов, пропущена\n", morph->paradigm_count - 1, MORPH_MAX_LINE - 2);
+            continue;
+        }
+        wchar_t *state;
+        for (wchar_t *tok = wcstok(line, L" \t\n", &state); tok; tok = wcstok(NULL, L" \t\n", &state)) {
+            if (p->count == endings_cap) {
+                endings_cap = endings_cap ? endings_cap * 2 : MORPH_INITIAL_ENDINGS;
+                wchar_t **endings = realloc(p->endings, endings_cap * sizeof(wchar_t*));
+                if (!endings) {
+                    fclose(file);
+                    return false;
+                }
+                p->endings = endings;
+            }
+            normalize_word(tok);
+            wchar_t *ending = wcsdup(wcscmp(tok, L"-") == 0 ? L"" : tok);
+            if (!ending) {
+                fclose(file);
+                return false;
+            }
+            p->endings[p->count++] = ending;
+            size_t len = wcslen(ending);
+            if (len > p->max_ending) p->max_ending = len;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+bool load_morphology(const char *paradigm_file, const char *stem_file, Morphology *morph) {
+    memset(morph, 0, sizeof(*morph));
+    if (!load_paradigms(paradigm_file, morph)) {
+        wprintf(L"Морфология отключена: не удалось прочитать %hs\n", paradigm_file);
+        free_morphology(morph);
+        return false;
+    }
+    FILE *file = fopen(stem_file, "r, ccs=UTF-8");
+    if (!file) {
+        wprintf(L"Морфология отключена: не удалось прочитать %hs\n", stem_file);
+        free_morphology(morph);
+        return false;
+    }
+
+    Trie trie = {0};
+    bool ok = trie_new_node(&trie) == 0;
+    size_t stems = 0;
+    wchar_t stem[256];
+    int paradigm;
+    while (ok && fwscanf(file, L"%255ls %d", stem, &paradigm) == 2) {
+        if (paradigm < 0 || paradigm >= morph->paradigm_count) continue;
+        normalize_word(stem);
+        ok = trie_insert(&trie, stem, paradigm);
+        stems++;
+        size_t len = wcslen(stem) + morph->paradigms[paradigm].max_ending;
+        if (len > morph->max_word_len) morph->max_word_len = len;
+    }
+    fclose(file);
+
+    if (ok) ok = compile_dafsa(&trie, morph);
+    for (int i = 0; i < trie.count; i++) free(trie.nodes[i].edges);
+    free(trie.nodes);
+    if (!ok) {
+        free_morphology(morph);
+        return false;
+    }
+    wprintf(L"Морфология: %zu основ, %d парадигм, %d узлов, %zu рёбер\n",
+            stems, morph->paradigm_count, morph->node_count, morph->edge_count);
+    return true;
+}
+
+void free_morphology(Morphology *morph) {
+    for (int i = 0; i < morph->paradigm_count; i++) {
+        for (int j = 0; j < morph->paradigms[i].count; j++) free(morph->paradigms[i].endings[j]);
+        free(morph->paradigms[i].endings);
+    }
+    free(morph->paradigms);
+    free(morph->node_first);
+    free(morph->edges);
+    memset(morph, 0, sizeof(*morph));
+}
+
+static bool paradigm_has_ending(const Paradigm *p, const wchar_t *ending) {
+    for (int i = 0; i < p->count; i++) {
+        if (wcscmp(p->endings[i], ending) == 0) return true;
+    }
+    return false;
+}
+
+bool morph_lookup(const Morphology *morph, const wchar_t *word) {
+    if (!morph || morph->node_count == 0) return false;
+    int node = morph->root;
+    for (size_t i = 0;; i++) {
+        int first = morph->node_first[node];
+        int last = morph->node_first[node + 1];
+        for (int e = last - 1; e >= first && morph->edges[e].label >= MORPH_PARADIGM_BASE; e--) {
+            if (paradigm_has_ending(&morph->paradigms[morph->edges[e].label - MORPH_PARADIGM_BASE], word + i)) {
+                return true;
+            }
+        }
+        if (word[i] == L'\0') return false;
+
+        int lo = first, hi = last - 1, next = -1;
+        while (lo <= hi) {
+            int mid = (lo + hi) / 2;
+            if (morph->edges[mid].label == word[i]) {
+                next = morph->edges[mid].target;
+                break;
+            }
+            if (morph->edges[mid].label < word[i]) lo = mid + 1;
+            else hi = mid - 1;
+        }
+        if (next < 0) return false;
+        node = next;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef MORPHOLOGY_H
+#define MORPHOLOGY_H
+
+#include <wchar.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MORPH_FILE_PARADIGMS "russian_paradigms.txt"
+#define MORPH_FILE_STEMS "russian_stems.txt"
+#define MORPH_INITIAL_ENDINGS 16
+#define MORPH_MAX_LINE 1024
+#define MORPH_PARADIGM_BASE 0xF0000
+
+typedef struct {
+    wchar_t **endings;
+    int count;
+    size_t max_ending;
+} Paradigm;
+
+typedef struct {
+    wchar_t label;
+    int target;
+} MorphEdge;
+
+typedef struct Morphology {
+    Paradigm *paradigms;
+    int paradigm_count;
+    int *node_first;
+    MorphEdge *edges;
+    int node_count;
+    int root;
+    size_t edge_count;
+    size_t max_word_len;
+} Morphology;
+
+bool load_morphology(const char *paradigm_file, const char *stem_file, Morphology *morph);
+void free_morphology(Morphology *morph);
+bool morph_lookup(const Morphology *morph, const wchar_t *word);
+
+#endif
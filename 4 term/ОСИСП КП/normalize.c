@@ -0,0 +1,27 @@
+#include <wchar.h>
+#include <wctype.h>
+#include "normalize.h"
+
+#if NORMALIZE_STRIP_DIACRITICS
+static const wchar_t latin1_base[] =
+        L"aaaaaaaceeeeiiii"
+        L"dnooooo\0ouuuuyts"
+        L"aaaaaaaceeeeiiii"
+        L"dnooooo\0ouuuuyty";
+#endif
+
+wchar_t normalize_char(wchar_t c) {
+    if (c == L'Ё' || c == L'ё') return L'е';
+    if (c < 0x80) return (c >= L'A' && c <= L'Z') ? c + 0x20 : c;
+    if (c >= 0x0410 && c <= 0x042F) return c + 0x20;
+#if NORMALIZE_STRIP_DIACRITICS
+    if (c >= 0x00C0 && c <= 0x00FF && latin1_base[c - 0x00C0]) return latin1_base[c - 0x00C0];
+#endif
+    return towlower(c);
+}
+
+void normalize_word(wchar_t *word) {
+    for (size_t i = 0; word[i]; i++) {
+        word[i] = normalize_char(word[i]);
+    }
+}
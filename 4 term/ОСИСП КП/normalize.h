@@ -0,0 +1,13 @@
+#ifndef NORMALIZE_H
+#define NORMALIZE_H
+
+#include <wchar.h>
+
+#ifndef NORMALIZE_STRIP_DIACRITICS
+#define NORMALIZE_STRIP_DIACRITICS 1
+#endif
+
+wchar_t normalize_char(wchar_t c);
+void normalize_word(wchar_t *word);
+
+#endif
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <locale.h>
+#include <X11/Xlib.h>
+#include <xkbcommon/xkbcommon.h>
+#include "dictionary.h"
+#include "morphology.h"
+#include "layout.h"
+#include "utils.h"
+#include "metrics.h"
+#include "normalize.h"
+
+int main(int argc, char **argv) {
+    setlocale(LC_ALL, "");
+    if (argc < 2) {
+        fwprintf(stderr, L"Usage: %hs corpus.txt > /dev/null\n", argv[0]);
+        return 1;
+    }
+
+    Dictionary eng_dict = {0}, rus_dict = {0};
+    if (!load_dictionary(DICT_FILE_ENG, &eng_dict) || !load_dictionary(DICT_FILE_RUS, &rus_dict)) {
+        free_dictionary(&eng_dict);
+        free_dictionary(&rus_dict);
+        return 1;
+    }
+    attach_morphology(&rus_dict, MORPH_FILE_PARADIGMS, MORPH_FILE_STEMS);
+    attach_fuzzy_index(&eng_dict);
+    attach_fuzzy_index(&rus_dict);
+
+    FILE *corpus = fopen(argv[1], "r, ccs=UTF-8");
+    if (!corpus) {
+        fwprintf(stderr, L"Не удалось открыть %hs\n", argv[1]);
+        free_dictionary(&eng_dict);
+        free_dictionary(&rus_dict);
+        return 1;
+    }
+
+    size_t words = 0, corrections = 0, toggles = 0;
+    // Simulated system layout: it changes only when a correction actually toggles it,
+    // so alternating corrections show up as toggles rather than as corrections.
+    int system_layout = 0;
+    wchar_t word[MAX_WORD_LEN];
+    wchar_t word_norm[MAX_WORD_LEN];
+    wchar_t converted_word[MAX_WORD_LEN];
+    wchar_t converted_norm[MAX_WORD_LEN];
+    double start = metrics_now();
+    while (fwscanf(corpus, L"%255ls", word) == 1) {
+        words++;
+        int layout = detect_word_layout(word, system_layout);
+        if (layout == 0) continue;
+        wcscpy(word_norm, word);
+        normalize_word(word_norm);
+        convert_layout(word, converted_word, converted_norm, MAX_WORD_LEN, layout == 1);
+        if (choose_correction(word_norm, converted_word, converted_norm, layout, &eng_dict, &rus_dict)) {
+            corrections++;
+            int target_layout = layout == 1 ? 1 : 0;
+            if (target_layout != system_layout) {
+                toggles++;
+                system_layout = target_layout;
+            }
+        }
+    }
+    double elapsed = metrics_now() - start;
+    fclose(corpus);
+
+    fwprintf(stderr, L"words: %zu, corrections: %zu, toggles per 100 words: %.2f, %.0f words/s\n",
+             words, corrections, words ? 100.0 * toggles / words : 0.0, elapsed > 0 ? words / elapsed : 0.0);
+    free_dictionary(&eng_dict);
+    free_dictionary(&rus_dict);
+    return 0;
+}
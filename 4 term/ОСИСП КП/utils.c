@@ -3,12 +3,16 @@
 #include <wchar.h>
 #include <string.h>
 #include "utils.h"
+#include "normalize.h"
+#include "metrics.h"
 
 const wchar_t eng_chars[] = L"qwertyuiop[]asdfghjkl;'zxcvbnm,./`QWERTYUIOP{}ASDFGHJKL:\"ZXCVBNM<>?~";
 const wchar_t rus_chars[] = L"йцукенгшщзхъфывапролджэячсмитьбю.ёЙЦУКЕНГШЩЗХЪФЫВАПРОЛДЖЭЯЧСМИТЬБЮ,Ё";
 
-void convert_layout(const wchar_t *input, wchar_t *output, bool to_russian) {
+void convert_layout(const wchar_t *input, wchar_t *output, wchar_t *folded, size_t output_size, bool to_russian) {
+    if (output_size == 0) return;
     size_t len = wcslen(input);
+    if (len > output_size - 1) len = output_size - 1;
     for (size_t i = 0; i < len; i++) {
         const wchar_t *pos;
         if (to_russian) {
@@ -18,11 +22,14 @@ void convert_layout(const wchar_t *input, wchar_t *output, bool to_russian) {
             pos = wcschr(rus_chars, input[i]);
             output[i] = pos ? eng_chars[pos - rus_chars] : input[i];
         }
+        if (folded) folded[i] = normalize_char(output[i]);
     }
     output[len] = L'\0';
+    if (folded) folded[len] = L'\0';
 }
 
 int get_gsettings_layout_group() {
+    metrics_inc(METRIC_GSETTINGS_CALLS);
     FILE *pipe = popen("gsettings get org.gnome.desktop.input-sources current", "r");
     if (!pipe) {
         wprintf(L"Failed to run gsettings\n");
@@ -8,7 +8,7 @@
 extern const wchar_t eng_chars[];
 extern const wchar_t rus_chars[];
 
-void convert_layout(const wchar_t *input, wchar_t *output, bool to_russian);
+void convert_layout(const wchar_t *input, wchar_t *output, wchar_t *folded, size_t output_size, bool to_russian);
 int get_gsettings_layout_group(void);
 
 #endif
\ No newline at end of file